@@ -0,0 +1,91 @@
+#include <apecs/events.hpp>
+#include <benchmark/benchmark.h>
+
+namespace {
+
+struct health { int value; };
+struct damage { apx::entity target; int amount; };
+
+using registry_type = apx::registry<health, damage>;
+
+// A frame of damage events, one for each of the given number of entities, sent, read
+// and cleared through a channel.
+void channel_events(benchmark::State& state)
+{
+    const auto count = static_cast<std::size_t>(state.range(0));
+    registry_type reg;
+    std::vector<apx::entity> entities;
+    for (std::size_t i = 0; i != count; ++i) {
+        entities.push_back(reg.create_with(health{100}));
+    }
+    apx::event_channel<damage> channel{count};
+    apx::event_reader<damage> reader;
+
+    for (auto _ : state) {
+        for (const apx::entity e : entities) {
+            channel.send(damage{e, 1});
+        }
+        channel.end_frame();
+        for (const damage& d : channel.read(reader)) {
+            reg.get<health>(d.target).value -= d.amount;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// The same, with the sending system collecting its events and sending them at once.
+void channel_batched_events(benchmark::State& state)
+{
+    const auto count = static_cast<std::size_t>(state.range(0));
+    registry_type reg;
+    std::vector<apx::entity> entities;
+    for (std::size_t i = 0; i != count; ++i) {
+        entities.push_back(reg.create_with(health{100}));
+    }
+    apx::event_channel<damage> channel{count};
+    apx::event_reader<damage> reader;
+    std::vector<damage> batch;
+
+    for (auto _ : state) {
+        batch.clear();
+        for (const apx::entity e : entities) {
+            batch.push_back(damage{e, 1});
+        }
+        channel.send(batch);
+        channel.end_frame();
+        for (const damage& d : channel.read(reader)) {
+            reg.get<health>(d.target).value -= d.amount;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// The same events as a component that is added for a frame and then removed.
+void component_events(benchmark::State& state)
+{
+    const auto count = static_cast<std::size_t>(state.range(0));
+    registry_type reg;
+    std::vector<apx::entity> entities;
+    for (std::size_t i = 0; i != count; ++i) {
+        entities.push_back(reg.create_with(health{100}));
+    }
+
+    for (auto _ : state) {
+        for (const apx::entity e : entities) {
+            reg.add<damage>(e, {e, 1});
+        }
+        for (auto [h, d] : reg.view_get<health, damage>()) {
+            h.value -= d.amount;
+        }
+        for (const apx::entity e : entities) {
+            reg.remove<damage>(e);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+}
+
+BENCHMARK(channel_events)->Arg(10'000);
+BENCHMARK(channel_batched_events)->Arg(10'000);
+BENCHMARK(component_events)->Arg(10'000);
@@ -0,0 +1,61 @@
+#include <apecs/recorder.hpp>
+#include <benchmark/benchmark.h>
+
+namespace {
+
+struct position { float x, y, z; };
+struct velocity { float x, y, z; };
+
+using registry_type = apx::registry<position, velocity>;
+
+void populate(registry_type& reg, std::size_t count)
+{
+    for (std::size_t i = 0; i != count; ++i) {
+        static_cast<void>(reg.create_with(position{0.0f, 0.0f, 0.0f}, velocity{1.0f, 0.0f, 0.0f}));
+    }
+}
+
+// What the simulation thread pays to record a frame.
+void capture_frame(benchmark::State& state)
+{
+    registry_type reg;
+    populate(reg, static_cast<std::size_t>(state.range(0)));
+    apx::recorder<registry_type, position, velocity> recorder{64};
+
+    // A frame's worth of simulation gives the thread time to keep up.
+    for (auto _ : state) {
+        recorder.capture(reg);
+        state.PauseTiming();
+        recorder.flush();
+        state.ResumeTiming();
+    }
+    state.counters["dropped"] = static_cast<double>(recorder.dropped());
+    state.SetBytesProcessed(state.iterations() * state.range(0) * static_cast<std::int64_t>(sizeof(position) + sizeof(velocity)));
+}
+
+// The same columns copied with nothing else going on, for comparison.
+void copy_columns(benchmark::State& state)
+{
+    registry_type reg;
+    populate(reg, static_cast<std::size_t>(state.range(0)));
+    std::vector<position> positions;
+    std::vector<velocity> velocities;
+    std::vector<apx::entity> keys;
+
+    for (auto _ : state) {
+        const auto& p = reg.storage<position>();
+        const auto& v = reg.storage<velocity>();
+        keys.assign(p.keys().begin(), p.keys().end());
+        positions.assign(p.values().begin(), p.values().end());
+        keys.assign(v.keys().begin(), v.keys().end());
+        velocities.assign(v.values().begin(), v.values().end());
+        benchmark::DoNotOptimize(positions.data());
+        benchmark::DoNotOptimize(velocities.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0) * static_cast<std::int64_t>(sizeof(position) + sizeof(velocity)));
+}
+
+}
+
+BENCHMARK(capture_frame)->Arg(10'000)->Arg(100'000);
+BENCHMARK(copy_columns)->Arg(10'000)->Arg(100'000);
@@ -0,0 +1,78 @@
+#include <apecs/relations.hpp>
+#include <benchmark/benchmark.h>
+
+namespace {
+
+struct owner { apx::entity value; };
+struct owned_by {};
+
+using registry_type = apx::registry<owner>;
+
+constexpr std::size_t player_count = 100;
+
+// Units owned by a hundred players, both as a relation and as a component naming the
+// owner.
+struct world
+{
+    registry_type                          reg;
+    apx::relations<registry_type, owned_by> rel{reg};
+    std::vector<apx::entity>               players;
+
+    explicit world(const std::size_t units)
+    {
+        for (std::size_t i = 0; i != player_count; ++i) {
+            players.push_back(reg.create());
+        }
+        for (std::size_t i = 0; i != units; ++i) {
+            const apx::entity player = players[i % player_count];
+            const apx::entity unit = reg.create_with(owner{player});
+            rel.link<owned_by>(unit, player);
+        }
+    }
+};
+
+// Finding the units of a player through the reverse index.
+void sources_lookup(benchmark::State& state)
+{
+    world w{static_cast<std::size_t>(state.range(0))};
+    std::size_t next = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(w.rel.sources<owned_by>(w.players[next]).size());
+        next = (next + 1) % player_count;
+    }
+}
+
+// The same by scanning every unit's owner component.
+void sources_scan(benchmark::State& state)
+{
+    world w{static_cast<std::size_t>(state.range(0))};
+    std::size_t next = 0;
+    for (auto _ : state) {
+        std::size_t count = 0;
+        for (const owner& o : w.reg.storage<owner>().values()) {
+            count += o.value == w.players[next];
+        }
+        benchmark::DoNotOptimize(count);
+        next = (next + 1) % player_count;
+    }
+}
+
+// Destroying a unit, which removes it from its player's list of thousands of units.
+void destroy_linked(benchmark::State& state)
+{
+    world w{static_cast<std::size_t>(state.range(0))};
+    for (auto _ : state) {
+        state.PauseTiming();
+        const apx::entity player = w.players[w.reg.size() % player_count];
+        const apx::entity unit = w.reg.create_with(owner{player});
+        w.rel.link<owned_by>(unit, player);
+        state.ResumeTiming();
+        w.reg.destroy(w.rel.sources<owned_by>(player).front());
+    }
+}
+
+}
+
+BENCHMARK(sources_lookup)->Arg(100'000);
+BENCHMARK(sources_scan)->Arg(100'000);
+BENCHMARK(destroy_linked)->Arg(100'000);
@@ -0,0 +1,62 @@
+#include <apecs/replication.hpp>
+#include <benchmark/benchmark.h>
+
+namespace {
+
+struct position { float x, y; };
+struct velocity { float x, y; };
+
+using registry_type = apx::registry<position, velocity>;
+using replicator_type = apx::replicator<registry_type, position, velocity>;
+
+// A frame in which one entity in a hundred moves, replicated to clients that each see
+// a strip of the world.
+void replicate_frame(benchmark::State& state)
+{
+    const auto entity_count = static_cast<std::size_t>(state.range(0));
+    const auto client_count = static_cast<std::size_t>(state.range(1));
+
+    registry_type reg;
+    std::vector<apx::entity> entities;
+    for (std::size_t i = 0; i != entity_count; ++i) {
+        entities.push_back(reg.create_with(position{static_cast<float>(i % client_count), 0.0f}, velocity{0.0f, 1.0f}));
+    }
+
+    replicator_type replicator{reg};
+    std::vector<replicator_type::consumer_id> clients;
+    for (std::size_t c = 0; c != client_count; ++c) {
+        clients.push_back(replicator.add_consumer([c](const registry_type& r, apx::entity e) {
+            return static_cast<std::size_t>(r.get<position>(e).x) == c;
+        }));
+    }
+
+    std::vector<std::byte> packet;
+    const auto send = [&] {
+        replicator.end_frame();
+        for (const auto c : clients) {
+            replicator.encode(c, packet);
+            replicator.acknowledge(c, replicator.seq());
+        }
+    };
+    send();
+
+    std::size_t next = 0;
+    for (auto _ : state) {
+        for (std::size_t i = 0; i != entity_count / 100; ++i) {
+            reg.patch<position>(entities[next], [](position& p) { p.y += 1.0f; });
+            next = (next + 97) % entity_count;
+        }
+        send();
+    }
+
+    std::size_t bytes = 0;
+    for (const auto c : clients) {
+        bytes += replicator.stats(c).last_bytes;
+    }
+    state.counters["bytes_per_client"] = static_cast<double>(bytes) / static_cast<double>(client_count);
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(client_count));
+}
+
+}
+
+BENCHMARK(replicate_frame)->Args({10'000, 10})->Args({100'000, 10})->Args({100'000, 100});
@@ -0,0 +1,62 @@
+#include <apecs/schedule.hpp>
+#include <benchmark/benchmark.h>
+
+namespace {
+
+struct transform { float x, y, z; };
+struct velocity { float x, y, z; };
+
+using registry_type = apx::registry<transform, velocity>;
+
+constexpr int stage_count = 6;
+
+void populate(registry_type& reg, std::size_t count)
+{
+    for (std::size_t i = 0; i != count; ++i) {
+        static_cast<void>(reg.create_with(transform{0.0f, 0.0f, 0.0f}, velocity{1.0f, 1.0f, 1.0f}));
+    }
+}
+
+// Six small systems over the same two components, each a loop of its own.
+void separate_loops(benchmark::State& state)
+{
+    registry_type reg;
+    populate(reg, static_cast<std::size_t>(state.range(0)));
+
+    for (auto _ : state) {
+        for (int s = 0; s != stage_count; ++s) {
+            for (auto [t, v] : reg.view_get<transform, velocity>()) {
+                t.x += v.x;
+                v.x = -v.x;
+            }
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// The same systems as stages of a schedule, which runs them in a single pass.
+void fused_stages(benchmark::State& state)
+{
+    registry_type reg;
+    populate(reg, static_cast<std::size_t>(state.range(0)));
+
+    apx::schedule<registry_type> schedule;
+    for (int s = 0; s != stage_count; ++s) {
+        schedule.add<transform, velocity>([](transform& t, velocity& v) {
+            t.x += v.x;
+            v.x = -v.x;
+        });
+    }
+
+    for (auto _ : state) {
+        schedule.run(reg);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+}
+
+BENCHMARK(separate_loops)->Range(1 << 10, 1 << 22);
+BENCHMARK(fused_stages)->Range(1 << 10, 1 << 22);
@@ -0,0 +1,72 @@
+#include <apecs/streaming.hpp>
+#include <benchmark/benchmark.h>
+
+namespace {
+
+struct position { float x, y, z; };
+struct velocity { float x, y, z; };
+struct health { int value; };
+
+using registry_type = apx::registry<position, velocity, health>;
+
+std::vector<std::byte> make_chunk(const std::size_t count)
+{
+    registry_type source;
+    std::vector<apx::entity> entities;
+    for (std::size_t i = 0; i != count; ++i) {
+        entities.push_back(source.create_with(position{0.0f, 0.0f, 0.0f}, velocity{1.0f, 0.0f, 0.0f}));
+        if (i % 2 == 0) {
+            source.add<health>(entities.back(), {100});
+        }
+    }
+    std::vector<std::byte> chunk;
+    apx::save_chunk(source, entities, chunk);
+    return chunk;
+}
+
+// What the owning thread pays to integrate a decoded chunk.
+void integrate_chunk(benchmark::State& state)
+{
+    const auto count = static_cast<std::size_t>(state.range(0));
+    const auto chunk = make_chunk(count);
+    apx::streaming_loader<registry_type> loader;
+    registry_type reg;
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        reg.clear();
+        loader.load(chunk);
+        loader.flush();
+        state.ResumeTiming();
+        loader.integrate(reg, count);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// The same entities created and given their components one at a time, as decoding
+// straight into the registry would.
+void add_one_at_a_time(benchmark::State& state)
+{
+    const auto count = static_cast<std::size_t>(state.range(0));
+    registry_type reg;
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        reg.clear();
+        state.ResumeTiming();
+        for (std::size_t i = 0; i != count; ++i) {
+            const apx::entity e = reg.create();
+            reg.add<position>(e, {0.0f, 0.0f, 0.0f});
+            reg.add<velocity>(e, {1.0f, 0.0f, 0.0f});
+            if (i % 2 == 0) {
+                reg.add<health>(e, {100});
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+}
+
+BENCHMARK(integrate_chunk)->Arg(10'000)->Arg(100'000);
+BENCHMARK(add_one_at_a_time)->Arg(10'000)->Arg(100'000);
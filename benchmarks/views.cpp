@@ -0,0 +1,368 @@
+#include <apecs/apecs.hpp>
+#include <benchmark/benchmark.h>
+
+#include <random>
+
+namespace {
+
+struct position { float x, y, z; };
+struct velocity { float x, y, z; };
+struct mass { float value; };
+
+using registry_type = apx::registry<position, velocity, mass>;
+
+// Creates a world where each entity independently has each component with the given
+// probability, so both sets end up a similar size and overlap at random.
+void populate(registry_type& reg, std::size_t count, double chance)
+{
+    std::mt19937 rng{42};
+    std::bernoulli_distribution has{chance};
+    for (std::size_t i = 0; i != count; ++i) {
+        auto e = reg.create();
+        if (has(rng)) reg.emplace<position>(e, 1.0f, 2.0f, 3.0f);
+        if (has(rng)) reg.emplace<velocity>(e, 0.1f, 0.2f, 0.3f);
+    }
+}
+
+void join(benchmark::State& state, apx::join_strategy strategy)
+{
+    registry_type reg;
+    if (strategy == apx::join_strategy::bitmap) {
+        reg.enable_bitmap<position>();
+        reg.enable_bitmap<velocity>();
+    }
+    populate(reg, static_cast<std::size_t>(state.range(0)), static_cast<double>(state.range(1)) / 1000.0);
+
+    const auto view = reg.view<position, velocity>().using_strategy(strategy);
+    for (auto _ : state) {
+        std::size_t count = 0;
+        for (auto entity : view) {
+            benchmark::DoNotOptimize(entity);
+            ++count;
+        }
+        benchmark::DoNotOptimize(count);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Gives every entity all three components, but adds each component to the entities in
+// a different random order, so that probing from one set into the others is random.
+void populate_shuffled(registry_type& reg, std::size_t count)
+{
+    std::vector<apx::entity> entities(count);
+    std::ranges::generate(entities, [&] { return reg.create(); });
+
+    std::mt19937 rng{42};
+    std::ranges::shuffle(entities, rng);
+    for (auto e : entities) reg.emplace<position>(e, 1.0f, 2.0f, 3.0f);
+    std::ranges::shuffle(entities, rng);
+    for (auto e : entities) reg.emplace<velocity>(e, 0.1f, 0.2f, 0.3f);
+    std::ranges::shuffle(entities, rng);
+    for (auto e : entities) reg.emplace<mass>(e, 1.0f);
+}
+
+void prefetched_view_get(benchmark::State& state)
+{
+    registry_type reg;
+    populate_shuffled(reg, static_cast<std::size_t>(state.range(0)));
+
+    const auto view = reg.view<position, velocity, mass>().with_prefetch(static_cast<std::size_t>(state.range(1)));
+    for (auto _ : state) {
+        float total = 0.0f;
+        for (auto entity : view) {
+            auto [p, v, m] = reg.get_all<position, velocity, mass>(entity);
+            total += (p.x + v.x) * m.value;
+        }
+        benchmark::DoNotOptimize(total);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void probe_join(benchmark::State& state) { join(state, apx::join_strategy::probe); }
+void merge_join(benchmark::State& state) { join(state, apx::join_strategy::merge); }
+void bitmap_join(benchmark::State& state) { join(state, apx::join_strategy::bitmap); }
+
+}
+
+// Arguments are the number of entities and the per-mille chance of having each component.
+BENCHMARK(probe_join)->ArgsProduct({{1 << 12, 1 << 16, 1 << 22}, {500, 20, 1}});
+BENCHMARK(merge_join)->ArgsProduct({{1 << 12, 1 << 16, 1 << 22}, {500, 20, 1}});
+BENCHMARK(bitmap_join)->ArgsProduct({{1 << 12, 1 << 16, 1 << 22}, {500, 20, 1}});
+
+// Arguments are the number of entities and the prefetch distance; the larger world does
+// not fit in cache.
+BENCHMARK(prefetched_view_get)->ArgsProduct({{1 << 14, 1 << 21}, {0, 4, 16, 64}});
+
+namespace {
+
+// The loops below compare view_get against the equivalent loops written by hand over
+// the same storage, which view_get should match.
+
+void view_get_single(benchmark::State& state)
+{
+    registry_type reg;
+    populate(reg, static_cast<std::size_t>(state.range(0)), 1.0);
+
+    for (auto _ : state) {
+        for (auto [p] : reg.view_get<position>()) {
+            p.x += 1.0f;
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void hand_written_single(benchmark::State& state)
+{
+    std::vector<position> positions(static_cast<std::size_t>(state.range(0)), {1.0f, 2.0f, 3.0f});
+
+    for (auto _ : state) {
+        for (auto& p : positions) {
+            p.x += 1.0f;
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void view_get_pair(benchmark::State& state)
+{
+    registry_type reg;
+    populate(reg, static_cast<std::size_t>(state.range(0)), 0.9);
+
+    for (auto _ : state) {
+        for (auto [p, v] : reg.view_get<position, velocity>()) {
+            p.x += v.x;
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void hand_written_pair(benchmark::State& state)
+{
+    apx::sparse_set<position> positions;
+    apx::sparse_set<velocity> velocities;
+
+    std::mt19937 rng{42};
+    std::bernoulli_distribution has{0.9};
+    for (std::size_t i = 0; i != static_cast<std::size_t>(state.range(0)); ++i) {
+        if (has(rng)) positions.emplace(i, 1.0f, 2.0f, 3.0f);
+        if (has(rng)) velocities.emplace(i, 0.1f, 0.2f, 0.3f);
+    }
+
+    for (auto _ : state) {
+        const auto keys = positions.keys();
+        auto values = positions.values();
+        for (std::size_t i = 0; i != keys.size(); ++i) {
+            if (velocities.has(keys[i])) {
+                values[i].x += velocities[keys[i]].x;
+            }
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+}
+
+BENCHMARK(view_get_single)->Range(1 << 10, 1 << 20);
+BENCHMARK(hand_written_single)->Range(1 << 10, 1 << 20);
+BENCHMARK(view_get_pair)->Range(1 << 10, 1 << 20);
+BENCHMARK(hand_written_pair)->Range(1 << 10, 1 << 20);
+
+namespace {
+
+// Counts the entities with all three components whose mass is below a threshold that
+// about one in a hundred pass, filtering after the join and before it with where().
+
+void number_masses(registry_type& reg)
+{
+    int i = 0;
+    for (auto [m] : reg.view_get<mass>()) {
+        m.value = static_cast<float>(i++ % 100);
+    }
+}
+
+void filter_after_join(benchmark::State& state)
+{
+    registry_type reg;
+    populate_shuffled(reg, static_cast<std::size_t>(state.range(0)));
+    number_masses(reg);
+
+    for (auto _ : state) {
+        std::size_t count = 0;
+        for (auto [p, v, m] : reg.view_get<position, velocity, mass>()) {
+            count += m.value < 1.0f;
+        }
+        benchmark::DoNotOptimize(count);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void filter_with_where(benchmark::State& state)
+{
+    registry_type reg;
+    populate_shuffled(reg, static_cast<std::size_t>(state.range(0)));
+    number_masses(reg);
+
+    for (auto _ : state) {
+        std::size_t count = 0;
+        const auto view = reg.view<position, velocity, mass>().where<mass>([](const mass& m) { return m.value < 1.0f; });
+        for (auto [p, v, m] : view.components()) {
+            benchmark::DoNotOptimize(p);
+            ++count;
+        }
+        benchmark::DoNotOptimize(count);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+}
+
+BENCHMARK(filter_after_join)->Range(1 << 10, 1 << 20);
+BENCHMARK(filter_with_where)->Range(1 << 10, 1 << 20);
+
+namespace {
+
+// Sums the masses of every entity with a hand-written loop and with registry::sum.
+
+void sum_loop(benchmark::State& state)
+{
+    registry_type reg;
+    populate_shuffled(reg, static_cast<std::size_t>(state.range(0)));
+
+    for (auto _ : state) {
+        float total = 0.0f;
+        for (auto [m] : reg.view_get<mass>()) {
+            total += m.value;
+        }
+        benchmark::DoNotOptimize(total);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void sum_reduce(benchmark::State& state)
+{
+    registry_type reg;
+    populate_shuffled(reg, static_cast<std::size_t>(state.range(0)));
+
+    const apx::reduce_options options{static_cast<std::size_t>(state.range(1)), true};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(reg.sum<mass>([](const mass& m) { return m.value; }, options));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+}
+
+BENCHMARK(sum_loop)->Range(1 << 10, 1 << 20);
+
+// Arguments are the number of entities and the number of threads.
+BENCHMARK(sum_reduce)->ArgsProduct({{1 << 10, 1 << 15, 1 << 20}, {1, 4}});
+
+namespace {
+
+// Keeps the positions in depth order while a few of them move every frame, refreshing
+// the cached order with view_sorted and sorting a copy of the entities from scratch.
+
+void nudge_depths(registry_type& reg, std::mt19937& rng)
+{
+    const auto entities = reg.view<position>();
+    std::uniform_int_distribution<std::size_t> pick{0, entities.size() - 1};
+    for (std::size_t i = 0; i != entities.size() / 100; ++i) {
+        reg.get<position>(entities[pick(rng)]).z += 0.5f;
+    }
+}
+
+void depth_order_refresh(benchmark::State& state)
+{
+    registry_type reg;
+    populate_shuffled(reg, static_cast<std::size_t>(state.range(0)));
+    std::mt19937 rng{42};
+    for (auto [p] : reg.view_get<position>()) p.z = std::uniform_real_distribution<float>{0.0f, 100.0f}(rng);
+
+    const auto depth = [](const position& p) { return p.z; };
+    for (auto _ : state) {
+        nudge_depths(reg, rng);
+        benchmark::DoNotOptimize(reg.view_sorted<position>(depth).data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void depth_order_resort(benchmark::State& state)
+{
+    registry_type reg;
+    populate_shuffled(reg, static_cast<std::size_t>(state.range(0)));
+    std::mt19937 rng{42};
+    for (auto [p] : reg.view_get<position>()) p.z = std::uniform_real_distribution<float>{0.0f, 100.0f}(rng);
+
+    for (auto _ : state) {
+        nudge_depths(reg, rng);
+        const auto entities = reg.view<position>();
+        std::vector<apx::entity> order{entities.begin(), entities.end()};
+        std::ranges::stable_sort(order, {}, [&](apx::entity e) { return reg.get<position>(e).z; });
+        benchmark::DoNotOptimize(order.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+}
+
+BENCHMARK(depth_order_refresh)->Range(1 << 10, 1 << 18);
+BENCHMARK(depth_order_resort)->Range(1 << 10, 1 << 18);
+
+namespace {
+
+// Reads the components of a random tenth of the entities, as from a spatial query,
+// one entity at a time with get_all and in bulk with gather.
+
+std::vector<apx::entity> random_query(registry_type& reg)
+{
+    const auto entities = reg.view<position>();
+    std::vector<apx::entity> query;
+    std::ranges::sample(entities, std::back_inserter(query), entities.size() / 10, std::mt19937{42});
+    std::ranges::shuffle(query, std::mt19937{7});
+    return query;
+}
+
+void query_get_all(benchmark::State& state)
+{
+    registry_type reg;
+    populate_shuffled(reg, static_cast<std::size_t>(state.range(0)));
+    const auto query = random_query(reg);
+
+    for (auto _ : state) {
+        float total = 0.0f;
+        for (auto e : query) {
+            auto [p, v] = reg.get_all<position, velocity>(e);
+            total += p.x * v.x;
+        }
+        benchmark::DoNotOptimize(total);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(query.size()));
+}
+
+void query_gather(benchmark::State& state)
+{
+    registry_type reg;
+    populate_shuffled(reg, static_cast<std::size_t>(state.range(0)));
+    const auto query = random_query(reg);
+    std::vector<position> positions(query.size());
+    std::vector<velocity> velocities(query.size());
+
+    for (auto _ : state) {
+        reg.gather<position, velocity>(query, positions, velocities);
+        float total = 0.0f;
+        for (std::size_t i = 0; i != query.size(); ++i) {
+            total += positions[i].x * velocities[i].x;
+        }
+        benchmark::DoNotOptimize(total);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(query.size()));
+}
+
+}
+
+BENCHMARK(query_get_all)->Range(1 << 12, 1 << 22);
+BENCHMARK(query_gather)->Range(1 << 12, 1 << 22);
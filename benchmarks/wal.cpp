@@ -0,0 +1,73 @@
+#include <apecs/wal.hpp>
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+
+namespace {
+
+struct position { float x, y, z; };
+struct velocity { float x, y, z; };
+
+using registry_type = apx::registry<position, velocity>;
+
+constexpr std::size_t entity_count = 100'000;
+constexpr std::size_t changes = 1'000'000;
+
+// A million writes through patch, committed in ticks of the given number of changes,
+// with or without a log attached.
+void write_changes(benchmark::State& state, const bool logged)
+{
+    const auto per_tick = static_cast<std::size_t>(state.range(0));
+    const auto dir = std::filesystem::temp_directory_path() / "apecs_wal_bench";
+    std::filesystem::create_directories(dir);
+
+    registry_type reg;
+    std::vector<apx::entity> entities;
+    for (std::size_t i = 0; i != entity_count; ++i) {
+        entities.push_back(reg.create_with(position{0.0f, 0.0f, 0.0f}, velocity{1.0f, 0.0f, 0.0f}));
+    }
+
+    std::optional<apx::write_ahead_log<registry_type>> log;
+    if (logged) {
+        log.emplace(reg, (dir / "world.ckpt").string(), (dir / "world.wal").string());
+    }
+
+    std::size_t next = 0;
+    for (auto _ : state) {
+        for (std::size_t done = 0; done < changes; done += per_tick) {
+            for (std::size_t i = 0; i != per_tick; ++i) {
+                reg.patch<position>(entities[next], [](position& p) { p.x += 1.0f; });
+                next = (next + 97) % entity_count;
+            }
+            if (log) {
+                log->commit();
+            }
+        }
+        if (log) {
+            log->sync();
+        }
+    }
+
+    if (log) {
+        state.counters["syncs"] = static_cast<double>(log->syncs());
+        log.reset();
+    }
+    std::filesystem::remove_all(dir);
+    state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(changes));
+}
+
+void wal_write(benchmark::State& state)
+{
+    write_changes(state, true);
+}
+
+// The same writes with nothing logging them, for comparison.
+void unlogged_write(benchmark::State& state)
+{
+    write_changes(state, false);
+}
+
+}
+
+BENCHMARK(wal_write)->Arg(1'000)->Arg(100'000)->Unit(benchmark::kMillisecond);
+BENCHMARK(unlogged_write)->Arg(1'000)->Unit(benchmark::kMillisecond);
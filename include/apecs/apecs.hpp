@@ -2,17 +2,35 @@
 #define APECS_HPP_
 
 #include <algorithm>
+#include <any>
+#include <array>
+#include <bit>
 #include <cassert>
+#include <concepts>
+#include <cstddef>
 #include <cstdint>
 #include <deque>
 #include <functional>
 #include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <optional>
 #include <ranges>
 #include <span>
+#include <thread>
 #include <tuple>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+
 namespace apx {
 namespace meta {
 
@@ -33,6 +51,21 @@ constexpr void for_each(Tuple&& tuple, F&& f)
 
 template <typename T> struct tag {};
 
+// Tells types apart at run time by the address of their value.
+template <typename T> struct type_id { static constexpr char value = 0; };
+
+// Applies the constness of From to To.
+template <typename From, typename To>
+using copy_const_t = std::conditional_t<std::is_const_v<From>, const To, To>;
+
+// The position of T within Ts.
+template <typename T, typename... Ts>
+constexpr std::size_t index_of()
+{
+    constexpr std::array<bool, sizeof...(Ts)> same{std::is_same_v<T, Ts>...};
+    return static_cast<std::size_t>(std::ranges::find(same, true) - same.begin());
+}
+
 template <typename... Ts>
 struct get_first;
 
@@ -41,14 +74,216 @@ struct get_first<T, Ts...> { using type = T; };
 
 }
 
-template <typename T>
+namespace detail {
+
+// Hints to the processor that the given address will be read soon.
+inline void prefetch([[maybe_unused]] const void* address) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(address);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#endif
+}
+
+// Returns the first position in [first, last) whose key is not less than the target,
+// assuming the keys are sorted. This is a plain forward scan; it is only used for short
+// ranges and is vectorised with AVX2 when available.
+template <typename Key>
+std::size_t scan(const Key* keys, std::size_t first, const std::size_t last, const Key target) noexcept
+{
+#if defined(__AVX2__)
+    if constexpr (sizeof(Key) == sizeof(std::uint64_t)) {
+        // AVX2 only has a signed 64-bit comparison, so flip the sign bits to compare unsigned.
+        const __m256i bias = _mm256_set1_epi64x(std::numeric_limits<std::int64_t>::min());
+        const __m256i wanted = _mm256_xor_si256(_mm256_set1_epi64x(std::bit_cast<std::int64_t>(target)), bias);
+        for (; first + 4 <= last; first += 4) {
+            const __m256i block = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + first)), bias);
+            const int less = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(wanted, block)));
+            if (less != 0xF) {
+                return first + std::countr_one(static_cast<unsigned>(less));
+            }
+        }
+    }
+#endif
+    while (first < last && keys[first] < target) {
+        ++first;
+    }
+    return first;
+}
+
+// As scan(), but if the target is not within the first few keys, gallops ahead so that
+// long runs of smaller keys are skipped in logarithmic time.
+template <typename Key>
+std::size_t seek(const Key* keys, std::size_t first, const std::size_t last, const Key target) noexcept
+{
+    constexpr std::size_t window = 8;
+    constexpr std::size_t scan_limit = 32;
+
+    // Joins of similarly sized sets mostly move a cursor by only a place or two.
+    const std::size_t near = std::min(first + window, last);
+    first = scan(keys, first, near, target);
+    if (first < near || near == last) {
+        return first;
+    }
+
+    std::size_t step = 1;
+    std::size_t low = first;
+    while (low + step < last && keys[low + step] < target) {
+        low += step;
+        step *= 2;
+    }
+    const std::size_t high = std::min(low + step, last);
+
+    if (high - low > scan_limit) {
+        return static_cast<std::size_t>(std::lower_bound(keys + low, keys + high, target) - keys);
+    }
+    return scan(keys, low, high, target);
+}
+
+}
+
+enum class entity : std::uint64_t {};
+using index_t = std::uint32_t;
+using version_t = std::uint32_t;
+
+static constexpr apx::entity null{std::numeric_limits<std::uint64_t>::max()};
+
+inline std::pair<index_t, version_t> split(const apx::entity id)
+{
+    using Int = std::underlying_type_t<apx::entity>;
+    const Int id_int = static_cast<Int>(id);
+    return {(index_t)(id_int >> 32), (version_t)id_int};
+}
+
+inline apx::entity combine(const index_t i, const version_t v)
+{
+    using Int = std::underlying_type_t<apx::entity>;
+    return static_cast<apx::entity>(((Int)i << 32) + (Int)v);
+}
+
+inline apx::index_t to_index(const apx::entity entity)
+{
+    return apx::split(entity).first;
+}
+
+// A compressed bitmap of indices. The index space is split into blocks of 4096 bits
+// which are only stored while they have any bits set, each with a summary word marking
+// which of its words are non-empty. Intersections can then AND a word of 64 indices at
+// a time and skip empty words and blocks without reading them.
+class bitmap_index
+{
+public:
+    using index_type = std::size_t;
+    using word_type = std::uint64_t;
+
+    static constexpr std::size_t word_bits = 64;
+    static constexpr std::size_t block_words = 64;
+    static constexpr std::size_t block_bits = word_bits * block_words;
+
+    struct block
+    {
+        word_type                            summary = 0;
+        std::array<word_type, block_words>   words = {};
+    };
+
+private:
+    static constexpr std::uint32_t NONE = std::numeric_limits<std::uint32_t>::max();
+
+    // Maps each block number to its slot in d_storage, or NONE if the block is empty.
+    std::vector<std::uint32_t> d_directory;
+    std::vector<block>         d_storage;
+    std::vector<std::uint32_t> d_free;
+    std::size_t                d_size = 0;
+
+public:
+    void insert(const index_type index)
+    {
+        const std::size_t b = index / block_bits;
+        if (d_directory.size() <= b) {
+            d_directory.resize(b + 1, NONE);
+        }
+        if (d_directory[b] == NONE) {
+            if (d_free.empty()) {
+                d_directory[b] = static_cast<std::uint32_t>(d_storage.size());
+                d_storage.emplace_back();
+            } else {
+                d_directory[b] = d_free.back();
+                d_free.pop_back();
+            }
+        }
+
+        block& blk = d_storage[d_directory[b]];
+        const std::size_t w = (index / word_bits) % block_words;
+        const word_type bit = word_type{1} << (index % word_bits);
+        d_size += (blk.words[w] & bit) == 0;
+        blk.words[w] |= bit;
+        blk.summary |= word_type{1} << w;
+    }
+
+    void erase(const index_type index)
+    {
+        assert(test(index));
+        const std::size_t b = index / block_bits;
+        block& blk = d_storage[d_directory[b]];
+        const std::size_t w = (index / word_bits) % block_words;
+        blk.words[w] &= ~(word_type{1} << (index % word_bits));
+        --d_size;
+
+        if (blk.words[w] == 0) {
+            blk.summary &= ~(word_type{1} << w);
+            if (blk.summary == 0) {
+                d_free.push_back(d_directory[b]);
+                d_directory[b] = NONE;
+            }
+        }
+    }
+
+    [[nodiscard]] bool test(const index_type index) const noexcept
+    {
+        const block* blk = find(index / block_bits);
+        return blk && (blk->words[(index / word_bits) % block_words] >> (index % word_bits) & 1);
+    }
+
+    void clear() noexcept
+    {
+        d_directory.clear();
+        d_storage.clear();
+        d_free.clear();
+        d_size = 0;
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        return d_size;
+    }
+
+    // The number of blocks spanned by the index space, including empty ones.
+    [[nodiscard]] std::size_t blocks() const noexcept
+    {
+        return d_directory.size();
+    }
+
+    // Returns the given block, or nullptr if it has no bits set.
+    [[nodiscard]] const block* find(const std::size_t b) const noexcept
+    {
+        return b < d_directory.size() && d_directory[b] != NONE ? &d_storage[d_directory[b]] : nullptr;
+    }
+};
+
+// A sparse set mapping indices to values. Each value is stored alongside a key, which
+// by default is just its index. The registry uses the owning entity as the key, so that
+// iterating a set yields entities without a lookup in the entity store.
+template <typename T, typename Key = std::size_t>
 class sparse_set
 {
 public:
     using index_type = std::size_t;
+    using key_type = Key;
     using value_type = T;
 
-    using packed_type = std::vector<std::pair<index_type, value_type>>;
+    using keys_type = std::vector<key_type>;
+    using values_type = std::vector<value_type>;
     using sparse_type = std::vector<index_type>;
 
 private:
@@ -56,9 +291,22 @@ private:
 
     static constexpr index_type EMPTY = std::numeric_limits<index_type>::max();
 
-    packed_type d_packed;
+    // The packed arrays are kept separately so that the keys can be scanned without
+    // pulling the values into cache.
+    keys_type   d_keys;
+    values_type d_values;
     sparse_type d_sparse;
 
+    // True while the packed keys are in ascending order. Appending a larger index keeps
+    // this, but erasing anything other than the back element breaks it.
+    bool d_sorted = true;
+
+    // True if insert and erase keep the packed keys in ascending order, see keep_sorted().
+    bool d_ordered = false;
+
+    // An optional second membership index, see enable_bitmap().
+    std::optional<apx::bitmap_index> d_bitmap;
+
     // Grows the sparse set so that the given index becomes valid.
     constexpr void assure(const index_type index)
     {
@@ -68,33 +316,127 @@ private:
         }
     }
 
+    // Points the sparse slots of the keys from the given position on at their positions.
+    constexpr void reindex(const std::size_t first)
+    {
+        for (std::size_t i = first; i != d_keys.size(); ++i) {
+            d_sparse[index_of(d_keys[i])] = i;
+        }
+    }
+
+    // Adds the given key to the packed keys and returns the position that its value must
+    // be inserted at, which is the back unless the set is kept sorted.
+    constexpr std::size_t push_key(const key_type key)
+    {
+        const index_type index = index_of(key);
+        assure(index);
+        if (d_bitmap) {
+            d_bitmap->insert(index);
+        }
+        if (d_ordered && !d_keys.empty() && key < d_keys.back()) {
+            const auto position = std::ranges::lower_bound(d_keys, key) - d_keys.begin();
+            d_keys.insert(d_keys.begin() + position, key);
+            reindex(position);
+            return position;
+        }
+        d_sorted = d_sorted && (d_keys.empty() || d_keys.back() < key);
+        d_sparse[index] = d_keys.size();
+        d_keys.push_back(key);
+        return d_keys.size() - 1;
+    }
+
+    template <typename... Args>
+    constexpr value_type& place(const key_type key, Args&&... args)
+    {
+        const std::size_t position = push_key(key);
+        if (position == d_values.size()) {
+            return d_values.emplace_back(std::forward<Args>(args)...);
+        }
+        return *d_values.emplace(d_values.begin() + position, std::forward<Args>(args)...);
+    }
+
 public:
     constexpr sparse_set() noexcept = default;
 
-    // Inserts the given value into the specified index. It is asserted that
+    // Returns the index that the given key is stored at.
+    [[nodiscard]] static constexpr index_type index_of(const key_type key) noexcept
+    {
+        if constexpr (std::is_same_v<key_type, apx::entity>) {
+            return apx::to_index(key);
+        } else {
+            return static_cast<index_type>(key);
+        }
+    }
+
+    // Inserts the given value at the index of the specified key. It is asserted that
     // no previous value exists at the index (see assert in assure()).
-    constexpr value_type& insert(const index_type index, const value_type& value)
+    constexpr value_type& insert(const key_type key, const value_type& value)
     {
-        assure(index);
-        d_sparse[index] = d_packed.size();
-        return d_packed.emplace_back(index, value).second;
+        return place(key, value);
     }
 
-    constexpr value_type& insert(const index_type index, value_type&& value)
+    constexpr value_type& insert(const key_type key, value_type&& value)
     {
-        assure(index);
-        d_sparse[index] = d_packed.size();
-        return d_packed.emplace_back(index, std::move(value)).second;
+        return place(key, std::move(value));
     }
 
     template <typename... Args>
-    constexpr value_type& emplace(const index_type index, Args&&... args)
+    constexpr value_type& emplace(const key_type key, Args&&... args)
     {
-        assure(index);
-        d_sparse[index] = d_packed.size();
-        return d_packed.emplace_back(std::piecewise_construct,
-                                     std::forward_as_tuple(index),
-                                     std::forward_as_tuple(std::forward<Args>(args)...)).second;
+        return place(key, std::forward<Args>(args)...);
+    }
+
+    // Appends each of the given keys with the value at the same position, none of which
+    // may be in the set yet. The arrays are grown once and copied into in bulk, rather
+    // than an element at a time. A set that is kept sorted places each one instead.
+    template <std::ranges::random_access_range Keys>
+        requires std::convertible_to<std::ranges::range_value_t<Keys>, key_type>
+    void insert(const Keys& keys, const std::span<const value_type> values)
+    {
+        const auto count = static_cast<std::size_t>(std::ranges::size(keys));
+        assert(count == values.size());
+        if (d_ordered) {
+            for (std::size_t i = 0; i != count; ++i) {
+                place(keys[i], values[i]);
+            }
+            return;
+        }
+        if (count == 0) {
+            return;
+        }
+
+        // Copied with ranges algorithms, as the keys may be a view whose iterators the
+        // containers do not accept.
+        reserve_index(std::ranges::max(keys | std::views::transform(&sparse_set::index_of)));
+        const std::size_t first = d_keys.size();
+        d_keys.resize(first + count);
+        std::ranges::copy(keys, d_keys.begin() + static_cast<std::ptrdiff_t>(first));
+        d_values.insert(d_values.end(), values.begin(), values.end());
+        for (std::size_t i = first; i != d_keys.size(); ++i) {
+            const index_type index = index_of(d_keys[i]);
+            assert(d_sparse[index] == EMPTY);
+            d_sparse[index] = i;
+            if (d_bitmap) {
+                d_bitmap->insert(index);
+            }
+            d_sorted = d_sorted && (i == 0 || d_keys[i - 1] < d_keys[i]);
+        }
+    }
+
+    // Makes room in the packed arrays for the given number of elements.
+    void reserve(const std::size_t count)
+    {
+        d_keys.reserve(count);
+        d_values.reserve(count);
+    }
+
+    // Grows the sparse array to cover the given index, so that inserting it afterwards
+    // does not need to.
+    void reserve_index(const index_type index)
+    {
+        if (d_sparse.size() <= index) {
+            d_sparse.resize(index + 1, EMPTY);
+        }
     }
 
     // Returns true if the specified index contains a value, and false otherwise.
@@ -106,8 +448,13 @@ public:
     // Removes all elements from the set.
     void clear() noexcept
     {
-        d_packed.clear();
+        d_keys.clear();
+        d_values.clear();
         d_sparse.clear();
+        d_sorted = true;
+        if (d_bitmap) {
+            d_bitmap->clear();
+        }
     }
 
     // Removes the value at the specified index. The structure may reorder
@@ -116,25 +463,56 @@ public:
     {
         assert(has(index));
 
-        if (d_sparse[index] == d_packed.size() - 1) {
-            d_sparse[index] = EMPTY;
-            d_packed.pop_back();
-            return;
+        // Get the index of the outgoing value within the packed arrays.
+        const std::size_t packed_index = d_sparse[index];
+        d_sparse[index] = EMPTY;
+
+        if (d_bitmap) {
+            d_bitmap->erase(index);
         }
 
-        // Pop the back element of the sparse_list
-        auto back = d_packed.back();
-        d_packed.pop_back();
+        // A sorted set closes the gap by shifting everything after it down.
+        if (d_ordered) {
+            d_keys.erase(d_keys.begin() + packed_index);
+            d_values.erase(d_values.begin() + packed_index);
+            reindex(packed_index);
+            return;
+        }
 
-        // Get the index of the outgoing value within the elements vector.
-        const std::size_t packed_index = d_sparse[index];
-        d_sparse[index] = EMPTY;
+        // Overwrite the outgoing value with the back value, and point the index for
+        // the back value to its new location.
+        if (packed_index != d_keys.size() - 1) {
+            d_keys[packed_index] = d_keys.back();
+            d_values[packed_index] = std::move(d_values.back());
+            d_sparse[index_of(d_keys[packed_index])] = packed_index;
+            d_sorted = false;
+        }
 
-        // Overwrite the outgoing value with the back value.
-        d_packed[packed_index] = back;
+        d_keys.pop_back();
+        d_values.pop_back();
+    }
 
-        // Point the index for the back value to its new location.
-        d_sparse[back.first] = packed_index;
+    // Inserts the value for the given key at the given position in the packed arrays,
+    // moving the element there to the back. This exactly undoes an erase() of the key
+    // from that position, which moved the back element into its place. A set that is
+    // kept sorted puts the key back in its place in the order instead.
+    template <typename V>
+    value_type& restore(const key_type key, V&& value, const std::size_t position)
+    {
+        assert(position <= d_keys.size());
+        if (d_ordered) {
+            return place(key, std::forward<V>(value));
+        }
+        push_key(key);
+        d_values.emplace_back(std::forward<V>(value));
+        if (position != d_keys.size() - 1) {
+            std::swap(d_keys[position], d_keys.back());
+            std::swap(d_values[position], d_values.back());
+            d_sparse[index_of(d_keys[position])] = position;
+            d_sparse[index_of(d_keys.back())] = d_keys.size() - 1;
+            d_sorted = false;
+        }
+        return d_values[position];
     }
 
     // Removes the value at the specified index, and does nothing if the index
@@ -146,102 +524,1686 @@ public:
         }
     }
 
+    // Reorders the packed arrays so that iteration visits indices in ascending order.
+    // The set stays sorted until an element other than the back one is erased.
+    void sort()
+    {
+        if (d_sorted) {
+            return;
+        }
+
+        std::vector<std::size_t> order(d_keys.size());
+        std::iota(order.begin(), order.end(), std::size_t{0});
+        std::ranges::sort(order, {}, [&](std::size_t i) { return d_keys[i]; });
+
+        keys_type keys;
+        values_type values;
+        keys.reserve(d_keys.size());
+        values.reserve(d_values.size());
+        for (const std::size_t i : order) {
+            d_sparse[index_of(d_keys[i])] = keys.size();
+            keys.push_back(d_keys[i]);
+            values.push_back(std::move(d_values[i]));
+        }
+
+        d_keys = std::move(keys);
+        d_values = std::move(values);
+        d_sorted = true;
+    }
+
+    // Sorts the set, and from then on has insert and erase keep it sorted, so that its
+    // order depends only on which indices it holds rather than the order they were added
+    // and removed in. This makes inserting or erasing anything but the largest index
+    // linear in the number of elements after it.
+    void keep_sorted(const bool enabled = true)
+    {
+        if (enabled) {
+            sort();
+        }
+        d_ordered = enabled;
+    }
+
+    [[nodiscard]] bool keeps_sorted() const noexcept
+    {
+        return d_ordered;
+    }
+
+    // Starts maintaining a bitmap of the indices in the set alongside the sparse array.
+    // This costs a little on every insert and erase, but lets views over several large
+    // sets intersect them a word at a time rather than probing each entity.
+    void enable_bitmap()
+    {
+        if (!d_bitmap) {
+            d_bitmap.emplace();
+            for (const key_type key : d_keys) {
+                d_bitmap->insert(index_of(key));
+            }
+        }
+    }
+
+    void disable_bitmap() noexcept
+    {
+        d_bitmap.reset();
+    }
+
+    // Returns the bitmap of indices in the set, or nullptr if it is not enabled.
+    [[nodiscard]] const apx::bitmap_index* bitmap() const noexcept
+    {
+        return d_bitmap ? &*d_bitmap : nullptr;
+    }
+
+    [[nodiscard]] bool is_sorted() const noexcept
+    {
+        return d_sorted;
+    }
+
     [[nodiscard]] std::size_t size() const noexcept
     {
-        return d_packed.size();
+        return d_keys.size();
+    }
+
+    // One past the largest index the set has had room for; the length of the sparse array.
+    [[nodiscard]] std::size_t extent() const noexcept
+    {
+        return d_sparse.size();
+    }
+
+    // The keys currently in the set, in iteration order.
+    [[nodiscard]] std::span<const key_type> keys() const noexcept
+    {
+        return d_keys;
+    }
+
+    // The values currently in the set, in iteration order.
+    [[nodiscard]] std::span<value_type> values() noexcept
+    {
+        return d_values;
+    }
+
+    [[nodiscard]] std::span<const value_type> values() const noexcept
+    {
+        return d_values;
+    }
+
+    // The position in the packed arrays of each index, or the maximum index_type for
+    // indices with no value. Views use this to fetch values without going through has().
+    [[nodiscard]] std::span<const index_type> sparse() const noexcept
+    {
+        return d_sparse;
+    }
+
+    // Returns the key stored with the value at the given index.
+    [[nodiscard]] key_type key(const index_type index) const
+    {
+        assert(has(index));
+        return d_keys[d_sparse[index]];
+    }
+
+    // Hints that the sparse slot for the given index is about to be read.
+    void prefetch(const index_type index) const noexcept
+    {
+        if (index < d_sparse.size()) {
+            apx::detail::prefetch(&d_sparse[index]);
+        }
+    }
+
+    // Hints that the value at the given index is about to be read. This reads the sparse
+    // slot, so should follow a prefetch() of the same index by some margin.
+    void prefetch_value(const index_type index) const noexcept
+    {
+        if (has(index)) {
+            apx::detail::prefetch(&d_values[d_sparse[index]]);
+        }
+    }
+
+    // Returns the value at the given index, or nullptr if there is none. This reads the
+    // sparse slot once, where has() followed by operator[] reads it twice.
+    [[nodiscard]] value_type* find(const index_type index) noexcept
+    {
+        const std::size_t packed_index = index < d_sparse.size() ? d_sparse[index] : EMPTY;
+        return packed_index != EMPTY ? &d_values[packed_index] : nullptr;
+    }
+
+    [[nodiscard]] const value_type* find(const index_type index) const noexcept
+    {
+        const std::size_t packed_index = index < d_sparse.size() ? d_sparse[index] : EMPTY;
+        return packed_index != EMPTY ? &d_values[packed_index] : nullptr;
     }
 
     [[nodiscard]] value_type& operator[](const index_type index)
     {
         assert(has(index));
-        return d_packed[d_sparse[index]].second;
+        return d_values[d_sparse[index]];
+    }
+
+    [[nodiscard]] const value_type& operator[](const index_type index) const
+    {
+        assert(has(index));
+        return d_values[d_sparse[index]];
+    }
+
+    // A range over the keys and values of the set together, yielding a pair of
+    // references to each.
+    template <typename Value>
+    class each_view : public std::ranges::view_interface<each_view<Value>>
+    {
+        const key_type* d_keys = nullptr;
+        Value*          d_values = nullptr;
+        std::size_t     d_size = 0;
+
+    public:
+        class iterator
+        {
+            const key_type* d_key = nullptr;
+            Value*          d_value = nullptr;
+
+        public:
+            using value_type = std::pair<const key_type&, Value&>;
+            using difference_type = std::ptrdiff_t;
+
+            iterator() = default;
+            iterator(const key_type* key, Value* value) : d_key{key}, d_value{value} {}
+
+            [[nodiscard]] value_type operator*() const
+            {
+                return {*d_key, *d_value};
+            }
+
+            iterator& operator++()
+            {
+                ++d_key;
+                ++d_value;
+                return *this;
+            }
+
+            iterator operator++(int)
+            {
+                auto copy = *this;
+                ++*this;
+                return copy;
+            }
+
+            [[nodiscard]] bool operator==(const iterator& other) const
+            {
+                return d_key == other.d_key;
+            }
+        };
+
+        each_view() = default;
+        each_view(const key_type* keys, Value* values, std::size_t size)
+            : d_keys{keys}, d_values{values}, d_size{size}
+        {}
+
+        [[nodiscard]] iterator begin() const { return {d_keys, d_values}; }
+        [[nodiscard]] iterator end() const { return {d_keys + d_size, d_values + d_size}; }
+        [[nodiscard]] std::size_t size() const { return d_size; }
+    };
+
+    [[nodiscard]] each_view<value_type> each() noexcept
+    {
+        return {d_keys.data(), d_values.data(), d_keys.size()};
+    }
+
+    [[nodiscard]] each_view<const value_type> each() const noexcept
+    {
+        return {d_keys.data(), d_values.data(), d_keys.size()};
+    }
+};
+
+// Marks a component in view_get as optional. Entities without it are still visited, and
+// it is yielded as a pointer to the component that is null for those entities.
+template <typename Comp>
+struct optional {};
+
+namespace meta {
+
+// Unwraps apx::optional, keeping the constness of either the wrapper or the component.
+template <typename T>
+struct component { using type = T; static constexpr bool is_optional = false; };
+
+template <typename T>
+struct component<apx::optional<T>> { using type = T; static constexpr bool is_optional = true; };
+
+template <typename T>
+struct component<const apx::optional<T>> { using type = const T; static constexpr bool is_optional = true; };
+
+template <typename T>
+using component_t = typename component<T>::type;
+
+template <typename T>
+inline constexpr bool is_optional_v = component<T>::is_optional;
+
+}
+
+// How a view over several component sets finds the entities present in all of them.
+enum class join_strategy
+{
+    // Walk the smallest set and test every other set for membership.
+    probe,
+
+    // Intersect the key arrays of every set in a single forward pass. Requires all
+    // of the sets to be sorted.
+    merge,
+
+    // AND the membership bitmaps of every set together a word at a time, skipping
+    // empty words and blocks. Requires all of the sets to have bitmaps enabled, and
+    // visits entities in index order.
+    bitmap,
+};
+
+// A view over the entities that have a value in every one of the given sets. The join
+// strategy is chosen on construction from the set sizes, whether they are sorted and
+// whether they have bitmaps, and may be overridden with using_strategy().
+//
+// Sets given as apx::optional<Comp> do not restrict the entities visited; they take no
+// part in the join and are only probed when their components are fetched.
+template <typename... Comps>
+class join_view : public std::ranges::view_interface<join_view<Comps...>>
+{
+public:
+    static constexpr std::size_t arity = sizeof...(Comps);
+    static_assert(arity > 1);
+    static_assert(!(apx::meta::is_optional_v<Comps> && ...), "a view needs at least one required component");
+
+    // Probing sorted sets walks their sparse arrays in order, which the hardware prefetcher
+    // handles well, so merging only pays off when those walks miss the cache on every probe.
+    // That needs sparse arrays too large to be cached that are also sparsely populated
+    // relative to the smallest set, and no set so much larger than the smallest one that
+    // scanning it costs more than the misses saved. See benchmarks/views.cpp.
+    static constexpr std::size_t merge_ratio = 8;
+    static constexpr std::size_t merge_stride = 16;
+    static constexpr std::size_t merge_extent = std::size_t{1} << 17;
+
+    // When probing an unsorted lead set whose partners are too large to be cached, each
+    // probe and fetch is a cache miss the hardware cannot predict, so the view prefetches
+    // the sparse slots and values of the other sets this many entities ahead.
+    static constexpr std::size_t prefetch_distance = 16;
+
+private:
+    using index_type = std::size_t;
+    using key_type = apx::entity;
+    using word_type = apx::bitmap_index::word_type;
+    using block_type = apx::bitmap_index::block;
+
+    static constexpr index_type EMPTY = std::numeric_limits<index_type>::max();
+
+    template <typename Comp>
+    using value_type_of = apx::meta::component_t<Comp>;
+
+    template <typename Comp>
+    using set_type = apx::meta::copy_const_t<value_type_of<Comp>, apx::sparse_set<std::remove_const_t<value_type_of<Comp>>, apx::entity>>;
+
+    // What fetching from each set yields: a reference, or a pointer for optional sets.
+    template <typename Comp>
+    using reference_of = std::conditional_t<apx::meta::is_optional_v<Comp>, value_type_of<Comp>*, value_type_of<Comp>&>;
+
+    static constexpr std::array<bool, arity> optional = {apx::meta::is_optional_v<Comps>...};
+
+    // The iteration state for every strategy; only the parts for the view's strategy
+    // are used.
+    struct cursor
+    {
+        apx::entity entity = apx::null;
+
+        // probe and merge: the position within each set's packed keys.
+        std::array<std::size_t, arity> pos = {};
+
+        // bitmap: the next block to visit, the words and bits left to visit in the
+        // current block and word, and the current block of every set.
+        std::size_t                            block = 0;
+        std::size_t                            word = 0;
+        word_type                              words = 0;
+        word_type                              bits = 0;
+        std::array<const block_type*, arity>   blocks = {};
+    };
+
+    std::tuple<set_type<Comps>*...> d_sets;
+
+    // The storage of each set, cached so that fetching components does not reload it
+    // through the sets after every write to a component.
+    std::tuple<value_type_of<Comps>*...>            d_values;
+    std::array<const index_type*, arity>            d_sparse = {};
+    std::array<std::size_t, arity>                  d_extents = {};
+    std::array<std::span<const key_type>, arity>    d_keys;
+    std::array<const apx::bitmap_index*, arity>     d_bitmaps = {};
+    join_strategy                                   d_strategy = join_strategy::probe;
+    std::size_t                                     d_lead = 0;
+    std::size_t                                     d_prefetch = 0;
+
+    // The first position in the lead set to visit; the last is the end of d_keys[d_lead].
+    // A view that has been sliced may have cut either end.
+    std::size_t                                     d_first = 0;
+    bool                                            d_sliced = false;
+
+    // The entities of the lead set that passed the where() clauses, which then drive
+    // the view in place of the lead set's keys.
+    std::shared_ptr<const std::vector<key_type>>    d_selection;
+
+    template <std::size_t... I>
+    bool contains(const key_type key, std::index_sequence<I...>) const
+    {
+        const index_type index = apx::to_index(key);
+        return ((I == d_lead || optional[I] || (d_bitmaps[I] ? d_bitmaps[I]->test(index) : index < d_extents[I] && d_sparse[I][index] != EMPTY)) && ...);
+    }
+
+    // Prefetches the sparse slots of the other sets for the entity twice the prefetch
+    // distance ahead, and their values for the entity one distance
+    // ahead, whose slots should have arrived by now.
+    template <std::size_t... I>
+    void prefetch_ahead(const std::size_t lead, std::index_sequence<I...>) const
+    {
+        const auto lead_keys = d_keys[d_lead];
+        if (const std::size_t ahead = lead + 2 * d_prefetch; ahead < lead_keys.size()) {
+            const index_type index = apx::to_index(lead_keys[ahead]);
+            ((I != d_lead ? std::get<I>(d_sets)->prefetch(index) : void()), ...);
+        }
+        if (const std::size_t ahead = lead + d_prefetch; ahead < lead_keys.size()) {
+            const index_type index = apx::to_index(lead_keys[ahead]);
+            ((I != d_lead ? std::get<I>(d_sets)->prefetch_value(index) : void()), ...);
+        }
+    }
+
+    std::size_t settle_probe_prefetched(std::size_t lead) const
+    {
+        const auto keys = d_keys[d_lead];
+        for (; lead < keys.size(); ++lead) {
+            prefetch_ahead(lead, std::index_sequence_for<Comps...>{});
+            if (contains(keys[lead], std::index_sequence_for<Comps...>{})) {
+                break;
+            }
+        }
+        return lead;
+    }
+
+    std::size_t settle_probe(std::size_t lead) const
+    {
+        if (d_prefetch != 0) {
+            return settle_probe_prefetched(lead);
+        }
+        const auto keys = d_keys[d_lead];
+        while (lead < keys.size() && !contains(keys[lead], std::index_sequence_for<Comps...>{})) {
+            ++lead;
+        }
+        return lead;
+    }
+
+    void settle_merge(std::array<std::size_t, arity>& pos) const
+    {
+        const auto lead_keys = d_keys[d_lead];
+        std::size_t& lead = pos[d_lead];
+
+        if constexpr (arity == 2 && !(apx::meta::is_optional_v<Comps> || ...)) {
+            // With two sets, stepping both cursors branch-free beats seeking, as most
+            // steps only move a cursor by a place or two.
+            const auto a = d_keys[0];
+            const auto b = d_keys[1];
+            while (pos[0] < a.size() && pos[1] < b.size()) {
+                const key_type x = a[pos[0]];
+                const key_type y = b[pos[1]];
+                if (x == y) {
+                    return;
+                }
+                pos[0] += x < y;
+                pos[1] += y < x;
+            }
+            lead = lead_keys.size();
+            return;
+        }
+
+        while (lead < lead_keys.size()) {
+            const key_type target = lead_keys[lead];
+            bool matched = true;
+            for (std::size_t k = 0; k != arity; ++k) {
+                if (k == d_lead || optional[k]) {
+                    continue;
+                }
+                const auto keys = d_keys[k];
+                pos[k] = apx::detail::seek(keys.data(), pos[k], keys.size(), target);
+                if (pos[k] == keys.size()) {
+                    lead = lead_keys.size();
+                    return;
+                }
+                if (keys[pos[k]] != target) {
+                    lead = apx::detail::seek(lead_keys.data(), lead + 1, lead_keys.size(), keys[pos[k]]);
+                    matched = false;
+                    break;
+                }
+            }
+            if (matched) {
+                return;
+            }
+        }
+    }
+
+    // Returns the entity stored at the given index of the lead set.
+    template <std::size_t... I>
+    key_type lead_key(const index_type index, std::index_sequence<I...>) const
+    {
+        key_type key = apx::null;
+        ((I == d_lead ? void(key = std::get<I>(d_sets)->key(index)) : void()), ...);
+        return key;
+    }
+
+    // Pops the next set bit of the intersection, loading further words and blocks as
+    // the current ones run out.
+    void settle_bitmap(cursor& c) const
+    {
+        std::size_t blocks = std::numeric_limits<std::size_t>::max();
+        for (std::size_t k = 0; k != arity; ++k) {
+            if (!optional[k]) {
+                blocks = std::min(blocks, d_bitmaps[k]->blocks());
+            }
+        }
+
+        while (c.bits == 0) {
+            while (c.words == 0) {
+                if (c.block == blocks) {
+                    c.entity = apx::null;
+                    return;
+                }
+                c.words = ~word_type{0};
+                for (std::size_t k = 0; k != arity; ++k) {
+                    if (optional[k]) {
+                        continue;
+                    }
+                    c.blocks[k] = d_bitmaps[k]->find(c.block);
+                    c.words &= c.blocks[k] ? c.blocks[k]->summary : 0;
+                }
+                ++c.block;
+            }
+
+            const std::size_t w = static_cast<std::size_t>(std::countr_zero(c.words));
+            c.words &= c.words - 1;
+            c.word = (c.block - 1) * apx::bitmap_index::block_words + w;
+            c.bits = ~word_type{0};
+            for (std::size_t k = 0; k != arity; ++k) {
+                if (!optional[k]) {
+                    c.bits &= c.blocks[k]->words[w];
+                }
+            }
+        }
+
+        const index_type index = c.word * apx::bitmap_index::word_bits + static_cast<std::size_t>(std::countr_zero(c.bits));
+        c.entity = lead_key(index, std::index_sequence_for<Comps...>{});
+        c.bits &= c.bits - 1;
+    }
+
+    // Moves the cursor onto an entity present in every set. For the probe and merge
+    // strategies this may be the current position.
+    void settle(cursor& c) const
+    {
+        if (d_strategy == join_strategy::bitmap) {
+            settle_bitmap(c);
+            return;
+        }
+
+        if (d_strategy == join_strategy::probe) {
+            c.pos[d_lead] = settle_probe(c.pos[d_lead]);
+        } else {
+            settle_merge(c.pos);
+        }
+        const auto lead_keys = d_keys[d_lead];
+        c.entity = c.pos[d_lead] < lead_keys.size() ? lead_keys[c.pos[d_lead]] : apx::null;
+    }
+
+    // Returns the component from the I'th set for the entity under the cursor. For an
+    // optional set this is the only probe of it, and yields nullptr on a miss.
+    template <std::size_t I>
+    [[nodiscard]] decltype(auto) fetch(const cursor& c) const
+    {
+        auto* values = std::get<I>(d_values);
+        if constexpr (optional[I]) {
+            const index_type index = apx::to_index(c.entity);
+            const index_type packed_index = index < d_extents[I] ? d_sparse[I][index] : EMPTY;
+            return packed_index != EMPTY ? values + packed_index : nullptr;
+        } else if (d_strategy == join_strategy::merge || (d_strategy == join_strategy::probe && I == d_lead && !d_selection)) {
+            return (values[c.pos[I]]);
+        } else {
+            return (values[d_sparse[I][apx::to_index(c.entity)]]);
+        }
+    }
+
+public:
+    class iterator
+    {
+        const join_view* d_view = nullptr;
+        cursor           d_cursor;
+
+        friend class join_view;
+
+    public:
+        using value_type = apx::entity;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+
+        [[nodiscard]] apx::entity operator*() const
+        {
+            return d_cursor.entity;
+        }
+
+        // Returns the components of the current entity.
+        [[nodiscard]] std::tuple<reference_of<Comps>...> components() const
+        {
+            return [&]<std::size_t... I>(std::index_sequence<I...>) {
+                return std::tuple<reference_of<Comps>...>{d_view->template fetch<I>(d_cursor)...};
+            }(std::index_sequence_for<Comps...>{});
+        }
+
+        iterator& operator++()
+        {
+            const join_view& view = *d_view;
+            if (view.d_strategy == join_strategy::probe) {
+                // Kept apart from settle() so that the common case stays small enough to inline.
+                const auto keys = view.d_keys[view.d_lead];
+                std::size_t& lead = d_cursor.pos[view.d_lead];
+                lead = view.settle_probe(lead + 1);
+                d_cursor.entity = lead < keys.size() ? keys[lead] : apx::null;
+                return *this;
+            }
+            if (view.d_strategy == join_strategy::merge) {
+                ++d_cursor.pos[view.d_lead];
+            }
+            view.settle(d_cursor);
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            auto copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        [[nodiscard]] bool operator==(const iterator& other) const
+        {
+            return d_cursor.entity == other.d_cursor.entity;
+        }
+    };
+
+    join_view() = default;
+
+    explicit join_view(set_type<Comps>&... sets)
+        : d_sets{&sets...}
+        , d_values{sets.values().data()...}
+        , d_sparse{sets.sparse().data()...}
+        , d_extents{sets.extent()...}
+        , d_keys{sets.keys()...}
+        , d_bitmaps{sets.bitmap()...}
+    {
+        // Only the required sets take part in choosing the strategy.
+        constexpr std::size_t none = std::numeric_limits<std::size_t>::max();
+        const std::array<std::size_t, arity> sizes{(apx::meta::is_optional_v<Comps> ? none : sets.size())...};
+        const std::array<std::size_t, arity> extents{(apx::meta::is_optional_v<Comps> ? none : sets.extent())...};
+        d_lead = static_cast<std::size_t>(std::ranges::min_element(sizes) - sizes.begin());
+
+        const std::size_t smallest = sizes[d_lead];
+        const std::size_t largest = std::max({(apx::meta::is_optional_v<Comps> ? 0 : sets.size())...});
+        const std::size_t extent = std::ranges::min(extents);
+        if (((apx::meta::is_optional_v<Comps> || sets.bitmap()) && ...)) {
+            d_strategy = join_strategy::bitmap;
+        } else if (((apx::meta::is_optional_v<Comps> || sets.is_sorted()) && ...)
+            && largest <= merge_ratio * smallest
+            && extent >= merge_extent
+            && extent >= merge_stride * smallest)
+        {
+            d_strategy = join_strategy::merge;
+        }
+
+        const std::array<bool, arity> sorted{sets.is_sorted()...};
+        const std::size_t largest_extent = std::max({sets.extent()...});
+        if (d_strategy == join_strategy::probe && !sorted[d_lead] && largest_extent >= merge_extent) {
+            d_prefetch = prefetch_distance;
+        }
+    }
+
+    [[nodiscard]] join_strategy strategy() const noexcept
+    {
+        return d_strategy;
+    }
+
+    // Returns a copy of this view that joins with the given strategy. Merging asserts
+    // that every set is sorted, and using bitmaps asserts that every set has one. Views
+    // filtered with where() can only probe.
+    [[nodiscard]] join_view using_strategy(const join_strategy strategy) const
+    {
+        assert(strategy != join_strategy::merge
+            || std::apply([](const auto*... sets) { return ((apx::meta::is_optional_v<Comps> || sets->is_sorted()) && ...); }, d_sets));
+        assert(strategy != join_strategy::bitmap
+            || std::apply([](const auto*... sets) { return ((apx::meta::is_optional_v<Comps> || sets->bitmap()) && ...); }, d_sets));
+        assert(strategy == join_strategy::probe || !d_selection);
+        auto copy = *this;
+        copy.d_strategy = strategy;
+        return copy;
+    }
+
+    // The number of entities ahead that the probe strategy prefetches, or zero if it
+    // does not prefetch.
+    [[nodiscard]] std::size_t prefetch() const noexcept
+    {
+        return d_prefetch;
+    }
+
+    // Returns a copy of this view that prefetches the given number of entities ahead
+    // when probing. Zero disables prefetching.
+    [[nodiscard]] join_view with_prefetch(const std::size_t distance) const
+    {
+        auto copy = *this;
+        copy.d_prefetch = distance;
+        return copy;
+    }
+
+    // The number of entities in the driving set, which bounds the size of the view. Its
+    // positions can be split with slice() to divide the view between threads.
+    [[nodiscard]] std::size_t driving_size() const noexcept
+    {
+        return d_keys[d_lead].size() - d_first;
+    }
+
+    // Returns a view over the entities at positions [first, last) of the driving set
+    // that are in every other set too. Slices with disjoint ranges visit disjoint
+    // entities, and each filters only its own part of the driving set. The bitmap
+    // strategy walks the index space rather than the driving set, so slices of it probe
+    // instead, still testing membership through the bitmaps.
+    [[nodiscard]] join_view slice(const std::size_t first, const std::size_t last) const
+    {
+        assert(first <= last && last <= driving_size());
+        auto copy = *this;
+        copy.d_keys[d_lead] = d_keys[d_lead].first(d_first + last);
+        copy.d_first = d_first + first;
+        copy.d_sliced = true;
+        if (copy.d_strategy == join_strategy::bitmap) {
+            copy.d_strategy = join_strategy::probe;
+        }
+        return copy;
+    }
+
+    // Returns a copy of this view that only visits entities whose Comp satisfies the
+    // predicate. The predicate is first run over the whole of Comp's storage, and the
+    // entities that pass are collected into a selection that then drives the view, so
+    // the other sets are only probed for those. When the view already has a selection
+    // or has been sliced, only the entities it would visit are tested instead. The view
+    // probes from then on.
+    template <typename Comp, typename Predicate>
+    [[nodiscard]] join_view where(Predicate&& predicate) const
+    {
+        constexpr std::size_t I = apx::meta::index_of<Comp, std::remove_const_t<value_type_of<Comps>>...>();
+        static_assert(I < arity, "where() needs a component of the view");
+        static_assert(!optional[I], "where() cannot filter on an optional component");
+
+        const auto* set = std::get<I>(d_sets);
+        const auto* values = std::get<I>(d_values);
+        auto selection = std::make_shared<std::vector<key_type>>();
+
+        if (!d_selection && !d_sliced) {
+            // A branch-free pass over the packed column: every key is written, but only
+            // kept by advancing past it when the predicate holds.
+            const auto keys = set->keys();
+            selection->resize(keys.size());
+            std::size_t count = 0;
+            for (std::size_t i = 0; i != keys.size(); ++i) {
+                (*selection)[count] = keys[i];
+                count += static_cast<std::size_t>(static_cast<bool>(predicate(std::as_const(values[i]))));
+            }
+            selection->resize(count);
+        } else {
+            const auto driving = d_keys[d_lead].subspan(d_first);
+            selection->reserve(driving.size());
+            for (const key_type key : driving) {
+                const index_type index = apx::to_index(key);
+                if (index < d_extents[I] && d_sparse[I][index] != EMPTY && predicate(std::as_const(values[d_sparse[I][index]]))) {
+                    selection->push_back(key);
+                }
+            }
+        }
+
+        auto copy = *this;
+        copy.d_strategy = join_strategy::probe;
+        copy.d_lead = I;
+        copy.d_first = 0;
+        copy.d_sliced = false;
+        copy.d_keys[I] = *selection;
+        copy.d_selection = std::move(selection);
+        return copy;
+    }
+
+    // Splits the driving set into the given number of near-equal parts and returns a
+    // slice over the given one.
+    [[nodiscard]] join_view chunk(const std::size_t index, const std::size_t count) const
+    {
+        assert(index < count);
+        const std::size_t size = driving_size();
+        return slice(size * index / count, size * (index + 1) / count);
+    }
+
+    [[nodiscard]] iterator begin() const
+    {
+        iterator it;
+        it.d_view = this;
+        it.d_cursor.pos[d_lead] = d_first;
+        if (d_strategy == join_strategy::merge && d_first != 0 && d_first < d_keys[d_lead].size()) {
+            const key_type target = d_keys[d_lead][d_first];
+            for (std::size_t k = 0; k != arity; ++k) {
+                if (k != d_lead && !optional[k]) {
+                    it.d_cursor.pos[k] = apx::detail::seek(d_keys[k].data(), 0, d_keys[k].size(), target);
+                }
+            }
+        }
+        settle(it.d_cursor);
+        return it;
+    }
+
+    [[nodiscard]] iterator end() const
+    {
+        iterator it;
+        it.d_view = this;
+        return it;
+    }
+
+    // A range over the same entities as a join_view, yielding a tuple of references to
+    // their components, with pointers for the optional ones. It owns its join_view, so its iterators must not outlive it.
+    class component_view : public std::ranges::view_interface<component_view>
+    {
+        join_view d_view;
+
+    public:
+        class iterator
+        {
+            typename join_view::iterator d_it;
+
+        public:
+            using value_type = std::tuple<reference_of<Comps>...>;
+            using difference_type = std::ptrdiff_t;
+
+            iterator() = default;
+            explicit iterator(typename join_view::iterator it) : d_it{it} {}
+
+            [[nodiscard]] value_type operator*() const
+            {
+                return d_it.components();
+            }
+
+            // The entity whose components these are.
+            [[nodiscard]] apx::entity entity() const
+            {
+                return *d_it;
+            }
+
+            iterator& operator++()
+            {
+                ++d_it;
+                return *this;
+            }
+
+            iterator operator++(int)
+            {
+                auto copy = *this;
+                ++*this;
+                return copy;
+            }
+
+            [[nodiscard]] bool operator==(std::default_sentinel_t) const
+            {
+                return *d_it == apx::null;
+            }
+        };
+
+        component_view() = default;
+        explicit component_view(const join_view& view) : d_view{view} {}
+
+        [[nodiscard]] iterator begin() const { return iterator{d_view.begin()}; }
+        [[nodiscard]] std::default_sentinel_t end() const { return {}; }
+    };
+
+    // Returns a range over the components of the entities in this view.
+    [[nodiscard]] component_view components() const
+    {
+        return component_view{*this};
+    }
+};
+
+// A set of entities kept sorted by index, which makes iterating it visit component
+// storage in index order and lets set operations run as linear merges. It is meant to
+// be materialised from a view once and then shared between systems, and reused from
+// frame to frame; assigning to it and the in-place operators keep its capacity.
+class entity_set
+{
+public:
+    using value_type = apx::entity;
+    using const_iterator = std::vector<apx::entity>::const_iterator;
+
+private:
+    std::vector<apx::entity> d_entities;
+    std::vector<apx::entity> d_scratch;
+
+public:
+    entity_set() = default;
+
+    template <std::ranges::input_range Range>
+    explicit entity_set(Range&& entities)
+    {
+        assign(std::forward<Range>(entities));
+    }
+
+    // Replaces the contents of the set with the given entities, such as a view.
+    template <std::ranges::input_range Range>
+    void assign(Range&& entities)
+    {
+        d_entities.clear();
+        for (const apx::entity entity : entities) {
+            d_entities.push_back(entity);
+        }
+        std::ranges::sort(d_entities);
+        const auto [first, last] = std::ranges::unique(d_entities);
+        d_entities.erase(first, last);
+    }
+
+    [[nodiscard]] bool contains(const apx::entity entity) const noexcept
+    {
+        return std::ranges::binary_search(d_entities, entity);
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        return d_entities.size();
+    }
+
+    [[nodiscard]] bool empty() const noexcept
+    {
+        return d_entities.empty();
+    }
+
+    void clear() noexcept
+    {
+        d_entities.clear();
+    }
+
+    [[nodiscard]] const_iterator begin() const noexcept
+    {
+        return d_entities.begin();
+    }
+
+    [[nodiscard]] const_iterator end() const noexcept
+    {
+        return d_entities.end();
+    }
+
+    // Keeps only the entities also in the other set. The smaller set drives the merge
+    // and gallops through the larger one.
+    entity_set& operator&=(const entity_set& other)
+    {
+        const auto& lhs = d_entities;
+        const auto& rhs = other.d_entities;
+        const bool lhs_drives = lhs.size() <= rhs.size();
+        const auto& driver = lhs_drives ? lhs : rhs;
+        const auto& target = lhs_drives ? rhs : lhs;
+
+        std::size_t out = 0;
+        std::size_t pos = 0;
+        for (std::size_t i = 0; i != driver.size() && pos != target.size(); ++i) {
+            pos = apx::detail::seek(target.data(), pos, target.size(), driver[i]);
+            if (pos != target.size() && target[pos] == driver[i]) {
+                d_entities[out++] = driver[i];
+            }
+        }
+        d_entities.resize(out);
+        return *this;
+    }
+
+    // Adds the entities in the other set.
+    entity_set& operator|=(const entity_set& other)
+    {
+        d_scratch.clear();
+        d_scratch.reserve(d_entities.size() + other.size());
+        std::ranges::set_union(d_entities, other.d_entities, std::back_inserter(d_scratch));
+        std::swap(d_entities, d_scratch);
+        return *this;
+    }
+
+    // Removes the entities in the other set.
+    entity_set& operator-=(const entity_set& other)
+    {
+        const auto& rhs = other.d_entities;
+        std::size_t out = 0;
+        std::size_t pos = 0;
+        for (std::size_t i = 0; i != d_entities.size(); ++i) {
+            pos = apx::detail::seek(rhs.data(), pos, rhs.size(), d_entities[i]);
+            if (pos == rhs.size() || rhs[pos] != d_entities[i]) {
+                d_entities[out++] = d_entities[i];
+            }
+        }
+        d_entities.resize(out);
+        return *this;
+    }
+
+    [[nodiscard]] friend entity_set operator&(entity_set lhs, const entity_set& rhs)
+    {
+        return lhs &= rhs;
+    }
+
+    [[nodiscard]] friend entity_set operator|(entity_set lhs, const entity_set& rhs)
+    {
+        return lhs |= rhs;
+    }
+
+    [[nodiscard]] friend entity_set operator-(entity_set lhs, const entity_set& rhs)
+    {
+        return lhs -= rhs;
+    }
+
+    [[nodiscard]] friend bool operator==(const entity_set& lhs, const entity_set& rhs) noexcept
+    {
+        return lhs.d_entities == rhs.d_entities;
+    }
+};
+
+// Identifies a component type of a registry at run time; see registry::id_of.
+using component_id = std::size_t;
+
+// A view over the entities that have every one of a set of components chosen at run
+// time, for queries that are built from data rather than code. Like join_view it walks
+// the smallest set and tests the others for membership, through their bitmaps if they
+// have them. Components are given as untyped pointers, found through the descriptions
+// of each set's storage that the registry looks up once on construction.
+class runtime_view : public std::ranges::view_interface<runtime_view>
+{
+public:
+    // The storage of one component set, without its type.
+    struct column
+    {
+        std::span<const apx::entity> keys;
+        const std::size_t*           sparse = nullptr;
+        std::size_t                  extent = 0;
+        const apx::bitmap_index*     bitmap = nullptr;
+        std::byte*                   values = nullptr;
+        std::size_t                  stride = 0;
+    };
+
+private:
+    static constexpr std::size_t EMPTY = std::numeric_limits<std::size_t>::max();
+
+    std::vector<column> d_columns;
+    std::size_t         d_lead = 0;
+
+    [[nodiscard]] bool contains(const apx::entity entity) const
+    {
+        const std::size_t index = apx::to_index(entity);
+        for (std::size_t k = 0; k != d_columns.size(); ++k) {
+            const column& c = d_columns[k];
+            if (k == d_lead) {
+                continue;
+            }
+            if (c.bitmap ? !c.bitmap->test(index) : index >= c.extent || c.sparse[index] == EMPTY) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Returns the first position from the given one in the lead set whose entity is
+    // in every other set.
+    [[nodiscard]] std::size_t settle(std::size_t pos) const
+    {
+        const auto keys = d_columns[d_lead].keys;
+        while (pos < keys.size() && !contains(keys[pos])) {
+            ++pos;
+        }
+        return pos;
+    }
+
+public:
+    class iterator
+    {
+        const runtime_view* d_view = nullptr;
+        std::size_t         d_pos = 0;
+
+        friend class runtime_view;
+
+    public:
+        using value_type = apx::entity;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+
+        [[nodiscard]] apx::entity operator*() const
+        {
+            return d_view->d_columns[d_view->d_lead].keys[d_pos];
+        }
+
+        // Returns the current entity's component from the k'th of the view's sets.
+        [[nodiscard]] void* component(const std::size_t k) const
+        {
+            const column& c = d_view->d_columns[k];
+            const std::size_t slot = k == d_view->d_lead ? d_pos : c.sparse[apx::to_index(**this)];
+            return c.values + slot * c.stride;
+        }
+
+        iterator& operator++()
+        {
+            d_pos = d_view->settle(d_pos + 1);
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            auto copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        [[nodiscard]] bool operator==(const iterator& other) const
+        {
+            return d_pos == other.d_pos;
+        }
+    };
+
+    runtime_view() = default;
+
+    explicit runtime_view(std::vector<column> columns) : d_columns{std::move(columns)}
+    {
+        assert(!d_columns.empty());
+        d_lead = static_cast<std::size_t>(std::ranges::min_element(d_columns, {}, [](const column& c) { return c.keys.size(); }) - d_columns.begin());
+    }
+
+    // The number of entities in the driving set, which bounds the size of the view.
+    [[nodiscard]] std::size_t driving_size() const noexcept
+    {
+        return d_columns[d_lead].keys.size();
+    }
+
+    [[nodiscard]] iterator begin() const
+    {
+        iterator it;
+        it.d_view = this;
+        it.d_pos = settle(0);
+        return it;
+    }
+
+    [[nodiscard]] iterator end() const
+    {
+        iterator it;
+        it.d_view = this;
+        it.d_pos = driving_size();
+        return it;
+    }
+};
+
+// How registry::reduce and the reductions built on it split their work.
+struct reduce_options
+{
+    // The number of threads to run on, including the calling thread.
+    std::size_t threads = 1;
+
+    // Reduce in fixed size blocks combined in order, so that the result does not
+    // depend on the number of threads. Otherwise the work is split into one part per
+    // thread, and a combine that is not associative, such as adding floats, can give
+    // slightly different results for different numbers of threads.
+    bool deterministic = false;
+};
+
+namespace detail {
+
+// The number of entities of the driving set in each block of a deterministic reduction.
+inline constexpr std::size_t reduce_block = std::size_t{1} << 14;
+
+// Splits the positions [0, size) into parts as the options ask, reduces each with
+// reduce_range(first, last), which returns an empty optional for a part with nothing
+// in it, and folds the partial results together in order with merge(into, from).
+template <typename Partial, typename ReduceRange, typename Merge>
+std::optional<Partial> parallel_reduce(const std::size_t size, const reduce_options& options, ReduceRange&& reduce_range, Merge&& merge)
+{
+    if (size == 0) {
+        return std::nullopt;
+    }
+
+    const std::size_t threads = std::max(options.threads, std::size_t{1});
+    const std::size_t parts = options.deterministic
+        ? (size + reduce_block - 1) / reduce_block
+        : std::min(threads, size);
+    const auto bound = [&](const std::size_t part) {
+        return options.deterministic ? std::min(part * reduce_block, size) : size * part / parts;
+    };
+
+    std::vector<std::optional<Partial>> partials(parts);
+    const std::size_t workers = std::min(threads, parts);
+    const auto work = [&](const std::size_t worker) {
+        for (std::size_t part = parts * worker / workers; part != parts * (worker + 1) / workers; ++part) {
+            partials[part] = reduce_range(bound(part), bound(part + 1));
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(workers - 1);
+    for (std::size_t worker = 1; worker < workers; ++worker) {
+        pool.emplace_back(work, worker);
+    }
+    work(0);
+    for (auto& thread : pool) {
+        thread.join();
+    }
+
+    std::optional<Partial> result;
+    for (auto& partial : partials) {
+        if (!partial) {
+            continue;
+        }
+        if (!result) {
+            result = std::move(partial);
+        } else {
+            merge(*result, std::move(*partial));
+        }
+    }
+    return result;
+}
+
+// Reduces map(values[i]) over [first, last) of a packed column. The range is split
+// into four contiguous quarters, the last taking any leftovers, each with its own
+// accumulator so that the compiler can overlap their work. The quarters are then
+// combined left to right, so the fold keeps the order of the range and combine only
+// needs to be associative.
+template <typename Value, typename Map, typename Combine>
+auto reduce_column(const Value* values, const std::size_t first, const std::size_t last, Map& map, Combine& combine)
+    -> std::optional<std::remove_cvref_t<std::invoke_result_t<Map&, const Value&>>>
+{
+    constexpr std::size_t lanes = 4;
+    if (first == last) {
+        return std::nullopt;
+    }
+    if (last - first < 2 * lanes) {
+        auto acc = map(values[first]);
+        for (std::size_t i = first + 1; i != last; ++i) {
+            acc = combine(std::move(acc), map(values[i]));
+        }
+        return acc;
+    }
+
+    const std::size_t quarter = (last - first) / lanes;
+    const Value* lane = values + first;
+    std::array acc{map(lane[0]), map(lane[quarter]), map(lane[2 * quarter]), map(lane[3 * quarter])};
+    for (std::size_t i = 1; i != quarter; ++i) {
+        for (std::size_t k = 0; k != lanes; ++k) {
+            acc[k] = combine(std::move(acc[k]), map(lane[k * quarter + i]));
+        }
+    }
+    for (std::size_t i = first + lanes * quarter; i != last; ++i) {
+        acc[lanes - 1] = combine(std::move(acc[lanes - 1]), map(values[i]));
+    }
+    return combine(combine(combine(std::move(acc[0]), std::move(acc[1])), std::move(acc[2])), std::move(acc[3]));
+}
+
+// Scrambles the bits of x so that nearby inputs give unrelated outputs (the splitmix64
+// finaliser).
+constexpr std::uint64_t mix(std::uint64_t x) noexcept
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
+
+}
+
+// Hashes a component for registry::checksum. The result must be the same on every
+// machine that the checksums are compared across. The default hashes the bytes of
+// trivially copyable components, so any padding in them must be zeroed, as it is by
+// value-initialisation; specialise this for other components, or to hash only some of
+// their fields. Registries with components that have no hash work as usual, but cannot
+// keep a checksum.
+template <typename T>
+struct component_hash
+{
+    [[nodiscard]] std::uint64_t operator()(const T& component) const noexcept
+        requires std::is_trivially_copyable_v<T>
+    {
+        if constexpr (std::is_empty_v<T>) {
+            return 0;
+        } else {
+            // FNV-1a
+            const auto* bytes = reinterpret_cast<const unsigned char*>(&component);
+            std::uint64_t hash = 0xcbf29ce484222325;
+            for (std::size_t i = 0; i != sizeof(T); ++i) {
+                hash = (hash ^ bytes[i]) * 0x100000001b3;
+            }
+            return hash;
+        }
+    }
+};
+
+template <typename T>
+concept hashable_component = requires(const T& component) {
+    { apx::component_hash<T>{}(component) } -> std::convertible_to<std::uint64_t>;
+};
+
+// Receives the changes made to a registry that it is attached to, see
+// registry::observe. Components are given by their registry's id_of and their address,
+// which is only valid for the duration of the call. Removed components are given as
+// they were, and written ones as they now are. Like the journal, only writes made
+// through patch are seen.
+class observer
+{
+public:
+    virtual ~observer() = default;
+
+    virtual void on_create(apx::entity) {}
+    virtual void on_destroy(apx::entity) {}
+    virtual void on_add(apx::entity, apx::component_id, const void*) {}
+    virtual void on_remove(apx::entity, apx::component_id, const void*) {}
+    virtual void on_write(apx::entity, apx::component_id, const void*) {}
+
+    // Called instead of on_destroy for each entity when the registry is cleared.
+    virtual void on_clear() {}
+};
+
+namespace detail {
+
+// The observers of a registry. They stay with the registry that they were attached to,
+// so copies of it start out with none. A registry with observers cannot be assigned
+// to, as they would miss the change.
+class observer_list
+{
+    std::vector<apx::observer*> d_observers;
+
+public:
+    observer_list() = default;
+
+    observer_list(const observer_list&) noexcept {}
+
+    observer_list& operator=(const observer_list&) noexcept
+    {
+        assert(d_observers.empty());
+        return *this;
+    }
+
+    void add(apx::observer& o)
+    {
+        d_observers.push_back(&o);
+    }
+
+    void remove(apx::observer& o)
+    {
+        std::erase(d_observers, &o);
+    }
+
+    [[nodiscard]] bool empty() const noexcept { return d_observers.empty(); }
+    [[nodiscard]] auto begin() const noexcept { return d_observers.begin(); }
+    [[nodiscard]] auto end() const noexcept { return d_observers.end(); }
+};
+
+}
+
+template <typename... Comps>
+class registry
+{
+public:
+    template <typename T>
+    using callback_t = std::function<void(apx::entity, const T&)>;
+
+    using predicate_t = std::function<bool(apx::entity)>;
+
+    // A tuple of tag types for metaprogramming purposes
+    inline static constexpr std::tuple<apx::meta::tag<Comps>...> tags{};
+
+private:
+    using tuple_type = std::tuple<apx::sparse_set<Comps, apx::entity>...>;
+
+    apx::sparse_set<apx::entity> d_entities;
+    std::deque<apx::entity>      d_pool;
+
+    tuple_type d_components;
+
+    // The last order given by view_sorted for a component and type of key function.
+    struct sorted_view
+    {
+        const char*              key_fn;
+        std::vector<apx::entity> entities;
+
+        // A buffer of the key of each entity and the entity, reused between calls. Its
+        // type depends on the key function, so it is held as a std::any.
+        std::any                 keyed;
+    };
+
+    // The orders of each component, and which positions of its packed arrays are in
+    // the order being brought up to date.
+    std::array<std::vector<sorted_view>, sizeof...(Comps)> d_sorted_views;
+    std::vector<bool>                                       d_sorted_seen;
+
+    // The inverse of a change recorded in the journal.
+    struct journal_entry
+    {
+        enum class kind : std::uint8_t { create, destroy, add, remove, write };
+
+        kind              what;
+        apx::component_id component;
+        apx::entity       entity;
+
+        // destroy and remove: the position in the packed arrays that was erased.
+        // create: one if the entity was recycled from the pool.
+        std::size_t       position;
+
+        // remove and write: where the old component is kept in the tick's values.
+        std::size_t       value;
+    };
+
+    // The changes made during one tick, oldest first, and the components that they
+    // removed or overwrote.
+    struct journal_tick
+    {
+        std::uint64_t                     tick = 0;
+        std::vector<journal_entry>        entries;
+        std::tuple<std::vector<Comps>...> values;
+
+        void clear()
+        {
+            entries.clear();
+            std::apply([](auto&... v) { (v.clear(), ...); }, values);
+        }
+    };
+
+    // The most recent ticks first to last, see enable_journal. A capacity of zero means
+    // that the journal is disabled.
+    std::deque<journal_tick> d_journal;
+    std::size_t              d_journal_capacity = 0;
+
+    // See enable_deterministic. The pool is then kept as a heap of the lowest index.
+    bool d_deterministic = false;
+
+    // The sum of the hashes of every entity and every component, while enabled, see
+    // enable_checksum.
+    std::optional<std::uint64_t> d_checksum;
+
+    [[nodiscard]] static std::uint64_t hash_of(const apx::entity entity) noexcept
+    {
+        return apx::detail::mix(static_cast<std::uint64_t>(entity));
+    }
+
+    template <typename Comp>
+    [[nodiscard]] static std::uint64_t hash_of(const apx::entity entity, const Comp& component) noexcept
+    {
+        const std::uint64_t value = apx::component_hash<Comp>{}(component);
+        return apx::detail::mix(hash_of(entity) ^ apx::detail::mix(value + id_of<Comp>() + 1));
+    }
+
+    // Adds the hash of an entity, or of one of its components, to the checksum, or takes
+    // it away again. Components without a hash are left out, as the checksum cannot be
+    // enabled for registries that have them.
+    template <typename... Comp>
+    void hash_in(const apx::entity entity, const Comp&... component) noexcept
+    {
+        if constexpr ((apx::hashable_component<Comp> && ...)) {
+            if (d_checksum) {
+                *d_checksum += hash_of(entity, component...);
+            }
+        }
+    }
+
+    template <typename... Comp>
+    void hash_out(const apx::entity entity, const Comp&... component) noexcept
+    {
+        if constexpr ((apx::hashable_component<Comp> && ...)) {
+            if (d_checksum) {
+                *d_checksum -= hash_of(entity, component...);
+            }
+        }
+    }
+
+    apx::detail::observer_list d_observers;
+
+    // Keep the checksum and the observers up to date with a change. Components are
+    // reported after they are added and written, and before they are removed.
+    void notify_create(const apx::entity entity)
+    {
+        hash_in(entity);
+        for (apx::observer* o : d_observers) {
+            o->on_create(entity);
+        }
+    }
+
+    void notify_destroy(const apx::entity entity)
+    {
+        hash_out(entity);
+        for (apx::observer* o : d_observers) {
+            o->on_destroy(entity);
+        }
+    }
+
+    template <typename Comp>
+    void notify_add(const apx::entity entity, const Comp& component)
+    {
+        hash_in(entity, component);
+        for (apx::observer* o : d_observers) {
+            o->on_add(entity, id_of<Comp>(), &component);
+        }
+    }
+
+    template <typename Comp>
+    void notify_remove(const apx::entity entity, const Comp& component)
+    {
+        hash_out(entity, component);
+        for (apx::observer* o : d_observers) {
+            o->on_remove(entity, id_of<Comp>(), &component);
+        }
+    }
+
+    // A write takes the old component out of the checksum, then puts the new one in and
+    // reports it.
+    template <typename Comp>
+    void notify_overwrite(const apx::entity entity, const Comp& component)
+    {
+        hash_out(entity, component);
+    }
+
+    template <typename Comp>
+    void notify_write(const apx::entity entity, const Comp& component)
+    {
+        hash_in(entity, component);
+        for (apx::observer* o : d_observers) {
+            o->on_write(entity, id_of<Comp>(), &component);
+        }
+    }
+
+    // In deterministic mode the pool is kept sorted by index, so that pool(), and so
+    // everything saved from it, depends only on which entities are in it.
+    [[nodiscard]] std::deque<apx::entity>::iterator pool_position(const apx::entity entity)
+    {
+        return std::ranges::lower_bound(d_pool, apx::to_index(entity), {}, apx::to_index);
+    }
+
+    // Takes the next destroyed entity to reuse from the pool: the one destroyed longest
+    // ago, or in deterministic mode the one with the lowest index.
+    [[nodiscard]] apx::entity take_from_pool()
+    {
+        const apx::entity entity = d_pool.front();
+        d_pool.pop_front();
+        return entity;
+    }
+
+    // Puts a destroyed entity in the pool. By default it goes to the back, to be reused
+    // last, unless it is being put back by rollback_to after being taken.
+    void return_to_pool(const apx::entity entity, const bool taken = false)
+    {
+        if (d_deterministic) {
+            d_pool.insert(pool_position(entity), entity);
+        } else if (taken) {
+            d_pool.push_front(entity);
+        } else {
+            d_pool.push_back(entity);
+        }
+    }
+
+    // Removes the entity most recently returned to the pool, for rollback_to.
+    void unreturn_to_pool(const apx::entity entity)
+    {
+        if (d_deterministic) {
+            const auto it = pool_position(entity);
+            assert(it != d_pool.end() && *it == entity);
+            d_pool.erase(it);
+        } else {
+            assert(d_pool.back() == entity);
+            d_pool.pop_back();
+        }
+    }
+
+    template <typename Comp>
+    void remove(const apx::entity entity, apx::sparse_set<Comp, apx::entity>& component_set)
+    {
+        if (has<Comp>(entity)) {
+            component_set.erase(apx::to_index(entity));
+        }
     }
 
-    [[nodiscard]] const value_type& operator[](const index_type index) const
+    template <typename Comp>
+    [[nodiscard]] apx::sparse_set<Comp, apx::entity>& get_comps()
     {
-        assert(has(index));
-        return d_packed[d_sparse[index]].second;
+        return std::get<apx::sparse_set<Comp, apx::entity>>(d_components);
     }
 
-    [[nodiscard]] auto each() noexcept
+    template <typename Comp>
+    [[nodiscard]] const apx::sparse_set<Comp, apx::entity>& get_comps() const
     {
-        return d_packed | std::views::transform([](auto& element) {
-            return std::make_pair(std::cref(element.first), std::ref(element.second));
-        });
+        return std::get<apx::sparse_set<Comp, apx::entity>>(d_components);
     }
 
-    [[nodiscard]] auto each() const noexcept
+    template <typename Comp>
+    [[nodiscard]] static apx::runtime_view::column column_of(registry& reg)
     {
-        return d_packed | std::views::transform([](const auto& element) {
-            return std::make_pair(std::cref(element.first), std::cref(element.second));
-        });
+        auto& set = reg.get_comps<Comp>();
+        return {
+            set.keys(),
+            set.sparse().data(),
+            set.extent(),
+            set.bitmap(),
+            reinterpret_cast<std::byte*>(set.values().data()),
+            sizeof(Comp)
+        };
     }
-};
-
-enum class entity : std::uint64_t {};
-using index_t = std::uint32_t;
-using version_t = std::uint32_t;
-
-static constexpr apx::entity null{std::numeric_limits<std::uint64_t>::max()};
-
-inline std::pair<index_t, version_t> split(const apx::entity id)
-{
-    using Int = std::underlying_type_t<apx::entity>;
-    const Int id_int = static_cast<Int>(id);
-    return {(index_t)(id_int >> 32), (version_t)id_int};
-}
-
-inline apx::entity combine(const index_t i, const version_t v)
-{
-    using Int = std::underlying_type_t<apx::entity>;
-    return static_cast<apx::entity>(((Int)i << 32) + (Int)v);
-}
 
-inline apx::index_t to_index(const apx::entity entity)
-{
-    return apx::split(entity).first;
-}
+    // Describes the storage of a component set given its id.
+    static constexpr std::array<apx::runtime_view::column (*)(registry&), sizeof...(Comps)> columns = {&registry::column_of<Comps>...};
 
-template <typename... Comps>
-class registry
-{
-public:
-    template <typename T>
-    using callback_t = std::function<void(apx::entity, const T&)>;
+    // The number of positions in the set that drives iteration over the given components.
+    template <typename... Ts>
+    [[nodiscard]] std::size_t driving_size() const
+    {
+        if constexpr (sizeof...(Ts) == 1) {
+            return get_comps<Ts...>().size();
+        } else {
+            return view<Ts...>().driving_size();
+        }
+    }
 
-    using predicate_t = std::function<bool(apx::entity)>;
+    // Calls f with the components of each entity at positions [first, last) of the set
+    // that drives iteration over them.
+    template <typename... Ts, typename F>
+    void for_each_in(const std::size_t first, const std::size_t last, F&& f) const
+    {
+        if constexpr (sizeof...(Ts) == 1) {
+            for (const auto& component : get_comps<Ts...>().values().subspan(first, last - first)) {
+                f(component);
+            }
+        } else {
+            for (const auto components : view<Ts...>().slice(first, last).components()) {
+                std::apply(f, components);
+            }
+        }
+    }
 
-    // A tuple of tag types for metaprogramming purposes
-    inline static constexpr std::tuple<apx::meta::tag<Comps>...> tags{};
+    template <typename... Ts, typename Map, typename Combine>
+    [[nodiscard]] auto reduce_partial(Map& map, Combine& combine, const apx::reduce_options& options) const
+    {
+        using result_type = std::remove_cvref_t<std::invoke_result_t<Map&, const Ts&...>>;
+        const auto merge = [&](result_type& into, result_type&& from) {
+            into = combine(std::move(into), std::move(from));
+        };
+        return apx::detail::parallel_reduce<result_type>(driving_size<Ts...>(), options, [&](std::size_t first, std::size_t last) {
+            if constexpr (sizeof...(Ts) == 1) {
+                return apx::detail::reduce_column(get_comps<Ts...>().values().data(), first, last, map, combine);
+            } else {
+                std::optional<result_type> acc;
+                for_each_in<Ts...>(first, last, [&](const Ts&... components) {
+                    acc = acc ? combine(std::move(*acc), map(components...)) : map(components...);
+                });
+                return acc;
+            }
+        }, merge);
+    }
 
-private:
-    using tuple_type = std::tuple<apx::sparse_set<Comps>...>;
+    // How far ahead of each entity of an arbitrary list its sparse slot is prefetched;
+    // its component is prefetched half as far ahead, once the slot should have arrived.
+    // This only pays off for sets too large to be cached, as join_view finds.
+    static constexpr std::size_t resolve_distance = 32;
+    static constexpr std::size_t resolve_extent = std::size_t{1} << 17;
 
-    apx::sparse_set<apx::entity> d_entities;
-    std::deque<apx::entity>      d_pool;
+    // Calls f(i, value) with the Comp of each of the entities, which must all have one.
+    template <typename Set, typename F>
+    static void resolve(Set& set, const std::span<const apx::entity> entities, F&& f)
+    {
+        const auto sparse = set.sparse();
+        const auto values = set.values();
+        const std::size_t size = entities.size();
+
+        std::size_t i = 0;
+        if (set.extent() >= resolve_extent) {
+            for (; i + resolve_distance < size; ++i) {
+                set.prefetch(apx::to_index(entities[i + resolve_distance]));
+                apx::detail::prefetch(&values[sparse[apx::to_index(entities[i + resolve_distance / 2])]]);
+                assert(set.has(apx::to_index(entities[i])));
+                f(i, values[sparse[apx::to_index(entities[i])]]);
+            }
+        }
+        for (; i != size; ++i) {
+            assert(set.has(apx::to_index(entities[i])));
+            f(i, values[sparse[apx::to_index(entities[i])]]);
+        }
+    }
 
-    tuple_type d_components;
+    // Returns the tick that changes are being recorded for, or nullptr if the journal
+    // is disabled or no tick has begun.
+    [[nodiscard]] journal_tick* recording() noexcept
+    {
+        return d_journal.empty() ? nullptr : &d_journal.back();
+    }
 
     template <typename Comp>
-    void remove(const apx::entity entity, apx::sparse_set<Comp>& component_set)
+    void record(const typename journal_entry::kind what, const apx::entity entity, const std::size_t position = 0)
     {
-        if (has<Comp>(entity)) {
-            component_set.erase(apx::to_index(entity));
+        if (journal_tick* log = recording()) {
+            log->entries.push_back({what, id_of<Comp>(), entity, position, 0});
         }
     }
 
+    // Records the given component as removed from or overwritten on the entity, so that
+    // undoing the change moves it back. A removed component is moved into the journal,
+    // and an overwritten one copied.
     template <typename Comp>
-    [[nodiscard]] apx::sparse_set<Comp>& get_comps()
+    void record_old(const typename journal_entry::kind what, const apx::entity entity, Comp old, const std::size_t position = 0)
     {
-        return std::get<apx::sparse_set<Comp>>(d_components);
+        if (journal_tick* log = recording()) {
+            auto& values = std::get<std::vector<Comp>>(log->values);
+            log->entries.push_back({what, id_of<Comp>(), entity, position, values.size()});
+            values.push_back(std::move(old));
+        }
     }
 
     template <typename Comp>
-    [[nodiscard]] const apx::sparse_set<Comp>& get_comps() const
+    static void undo(registry& reg, journal_tick& log, const journal_entry& entry)
     {
-        return std::get<apx::sparse_set<Comp>>(d_components);
+        using kind = typename journal_entry::kind;
+        auto& set = reg.get_comps<Comp>();
+        const apx::index_t index = apx::to_index(entry.entity);
+        auto& values = std::get<std::vector<Comp>>(log.values);
+        if (entry.what == kind::add) {
+            reg.notify_remove(entry.entity, set[index]);
+            set.erase(index);
+        } else if (entry.what == kind::remove) {
+            reg.notify_add(entry.entity, set.restore(entry.entity, std::move(values[entry.value]), entry.position));
+        } else {
+            reg.notify_overwrite(entry.entity, set[index]);
+            reg.notify_write(entry.entity, set[index] = std::move(values[entry.value]));
+        }
     }
 
+    // Undoes a change to a component set given its id.
+    static constexpr std::array<void (*)(registry&, journal_tick&, const journal_entry&), sizeof...(Comps)> undo_component = {&registry::undo<Comps>...};
+
 public:
     ~registry()
     {
@@ -252,17 +2214,48 @@ public:
     {
         index_t index = (index_t)d_entities.size();
         version_t version = 0;
-        if (!d_pool.empty()) {
-            std::tie(index, version) = split(d_pool.front());
-            d_pool.pop_front();
+        const bool recycled = !d_pool.empty();
+        if (recycled) {
+            std::tie(index, version) = split(take_from_pool());
             ++version;
         }
 
         const apx::entity id = combine(index, version);
         d_entities.insert(index, id);
+        notify_create(id);
+        if (journal_tick* log = recording()) {
+            log->entries.push_back({journal_entry::kind::create, 0, id, recycled, 0});
+        }
         return id;
     }
 
+    // Creates an entity for each position of the given array. Entities are reused from
+    // the pool one at a time as usual, and the rest are given the next unused indices,
+    // which are added to the entity store in one go.
+    void create(const std::span<apx::entity> entities)
+    {
+        const std::size_t recycled = std::min(entities.size(), d_pool.size());
+        for (std::size_t i = 0; i != recycled; ++i) {
+            entities[i] = create();
+        }
+
+        // With the pool empty, every index below the size of the store is in use.
+        const auto fresh = entities.subspan(recycled);
+        const std::size_t first = d_entities.size();
+        for (std::size_t i = 0; i != fresh.size(); ++i) {
+            fresh[i] = combine(static_cast<index_t>(first + i), 0);
+        }
+        d_entities.insert(std::views::iota(first, first + fresh.size()), fresh);
+        if (recording() || d_checksum || !d_observers.empty()) {
+            for (const apx::entity entity : fresh) {
+                notify_create(entity);
+                if (journal_tick* log = recording()) {
+                    log->entries.push_back({journal_entry::kind::create, 0, entity, 0, 0});
+                }
+            }
+        }
+    }
+
     [[nodiscard]] bool valid(const apx::entity entity) const noexcept
     {
         const apx::index_t index = apx::to_index(entity);
@@ -271,11 +2264,30 @@ public:
             && d_entities[index] == entity;
     }
 
+    // Returns true if every one of the entities is valid, checking them in a single
+    // pass that prefetches the entity store ahead of each check.
+    [[nodiscard]] bool valid(const std::span<const apx::entity> entities) const noexcept
+    {
+        bool all = true;
+        for (std::size_t i = 0; i != entities.size(); ++i) {
+            if (i + resolve_distance < entities.size()) {
+                d_entities.prefetch(apx::to_index(entities[i + resolve_distance]));
+            }
+            all &= valid(entities[i]);
+        }
+        return all;
+    }
+
     void destroy(const apx::entity entity)
     {
         assert(valid(entity));
         remove_all_components(entity);
-        d_pool.push_back(entity);
+        if (journal_tick* log = recording()) {
+            const std::size_t position = d_entities.sparse()[apx::to_index(entity)];
+            log->entries.push_back({journal_entry::kind::destroy, 0, entity, position, 0});
+        }
+        notify_destroy(entity);
+        return_to_pool(entity);
         d_entities.erase(apx::to_index(entity));
     }
 
@@ -296,44 +2308,281 @@ public:
 
     void clear()
     {
-        d_components = {};
+        std::apply([](auto&... sets) { (sets.clear(), ...); }, d_components);
+        std::ranges::for_each(d_sorted_views, [](auto& views) { views.clear(); });
         d_entities.clear();
         d_pool.clear();
+        d_journal.clear();
+        if (d_checksum) {
+            d_checksum = 0;
+        }
+        for (apx::observer* o : d_observers) {
+            o->on_clear();
+        }
     }
 
     template <typename Comp>
     Comp& add(const apx::entity entity, const Comp& component)
     {
-        static_assert(apx::meta::tuple_contains_v<apx::sparse_set<Comp>, tuple_type>);
+        static_assert(apx::meta::tuple_contains_v<apx::sparse_set<Comp, apx::entity>, tuple_type>);
         assert(valid(entity));
-        return get_comps<Comp>().insert(apx::to_index(entity), component);
+        Comp& added = get_comps<Comp>().insert(entity, component);
+        record<Comp>(journal_entry::kind::add, entity);
+        notify_add(entity, added);
+        return added;
     }
 
     template <typename Comp>
     Comp& add(const apx::entity entity, Comp&& component)
     {
         using T = std::remove_cvref_t<Comp>;
-        static_assert(apx::meta::tuple_contains_v<apx::sparse_set<T>, tuple_type>);
+        static_assert(apx::meta::tuple_contains_v<apx::sparse_set<T, apx::entity>, tuple_type>);
         assert(valid(entity));
-        return get_comps<T>().insert(apx::to_index(entity), std::forward<T>(component));
+        T& added = get_comps<T>().insert(entity, std::forward<T>(component));
+        record<T>(journal_entry::kind::add, entity);
+        notify_add(entity, added);
+        return added;
     }
 
     template <typename Comp, typename... Args>
     Comp& emplace(const apx::entity entity, Args&&... args)
     {
-        static_assert(apx::meta::tuple_contains_v<apx::sparse_set<Comp>, tuple_type>);
+        static_assert(apx::meta::tuple_contains_v<apx::sparse_set<Comp, apx::entity>, tuple_type>);
+        assert(valid(entity));
+        Comp& added = get_comps<Comp>().emplace(entity, std::forward<Args>(args)...);
+        record<Comp>(journal_entry::kind::add, entity);
+        notify_add(entity, added);
+        return added;
+    }
+
+    // Adds the component at each position of the given array to the entity at the same
+    // position of the other, none of which may have it yet. The component's storage is
+    // grown once and copied into in bulk, rather than a component at a time.
+    template <typename Comp>
+    void add(const std::span<const apx::entity> entities, const std::span<const Comp> components)
+    {
+        static_assert(apx::meta::tuple_contains_v<apx::sparse_set<Comp, apx::entity>, tuple_type>);
+        assert(valid(entities));
+        auto& set = get_comps<Comp>();
+        set.insert(entities, components);
+        if (recording() || d_checksum || !d_observers.empty()) {
+            for (const apx::entity entity : entities) {
+                record<Comp>(journal_entry::kind::add, entity);
+                notify_add(entity, set[apx::to_index(entity)]);
+            }
+        }
+    }
+
+    // Constructs each of the given components on the entity from the corresponding
+    // argument, and returns references to them. The entity is checked once, and every
+    // set is grown to fit it before any component is added.
+    template <typename... Ts, typename... Args>
+    std::tuple<Ts&...> emplace_all(const apx::entity entity, Args&&... args)
+    {
+        static_assert(sizeof...(Ts) == sizeof...(Args), "emplace_all takes one argument per component");
+        static_assert((apx::meta::tuple_contains_v<apx::sparse_set<Ts, apx::entity>, tuple_type> && ...));
         assert(valid(entity));
-        return get_comps<Comp>().emplace(apx::to_index(entity), std::forward<Args>(args)...);
+        const apx::index_t index = apx::to_index(entity);
+        (get_comps<Ts>().reserve_index(index), ...);
+        std::tuple<Ts&...> added{get_comps<Ts>().emplace(entity, std::forward<Args>(args))...};
+        (record<Ts>(journal_entry::kind::add, entity), ...);
+        std::apply([&](const Ts&... components) { (notify_add(entity, components), ...); }, added);
+        return added;
+    }
+
+    // Creates an entity with the given components; see emplace_all.
+    template <typename... Ts>
+    [[nodiscard]] apx::entity create_with(Ts&&... components)
+    {
+        const apx::entity entity = create();
+        emplace_all<std::remove_cvref_t<Ts>...>(entity, std::forward<Ts>(components)...);
+        return entity;
     }
 
     template <typename Comp>
     void remove(const apx::entity entity)
     {
-        static_assert(apx::meta::tuple_contains_v<apx::sparse_set<Comp>, tuple_type>);
+        static_assert(apx::meta::tuple_contains_v<apx::sparse_set<Comp, apx::entity>, tuple_type>);
         assert(valid(entity));
         if (has<Comp>(entity)) {
-            get_comps<Comp>().erase(apx::to_index(entity));
+            auto& set = get_comps<Comp>();
+            const apx::index_t index = apx::to_index(entity);
+            notify_remove(entity, set[index]);
+            if (recording()) {
+                record_old<Comp>(journal_entry::kind::remove, entity, std::move(set[index]), set.sparse()[index]);
+            }
+            set.erase(index);
+        }
+    }
+
+    // Calls f with a reference to the entity's component and returns it, recording the
+    // component's old value in the journal if there is one. Changes made to components
+    // in any other way are not recorded, so are not undone by rollback_to or seen by
+    // the checksum. Writes to components that cannot be copied are not recorded
+    // either: they can be added and removed under the journal, but rollback_to leaves
+    // their values as they are.
+    template <typename Comp, typename F>
+    Comp& patch(const apx::entity entity, F&& f)
+    {
+        Comp& component = get<Comp>(entity);
+        if constexpr (std::is_copy_constructible_v<Comp>) {
+            if (recording()) {
+                record_old<Comp>(journal_entry::kind::write, entity, component);
+            }
+        }
+        notify_overwrite(entity, component);
+        std::forward<F>(f)(component);
+        notify_write(entity, component);
+        return component;
+    }
+
+    // Switches to deterministic mode, in which the order of iteration depends only on
+    // the registry's contents rather than the order of the changes that led to them, so
+    // that worlds built up differently, say on different machines or from a save, go on
+    // to behave the same. Every set is kept sorted by entity index, so views visit
+    // entities in index order and can always use a merge join, and create reuses the
+    // lowest destroyed index rather than the oldest. The price is that adding or removing
+    // a component, or destroying an entity, shifts the part of its set after it.
+    void enable_deterministic()
+    {
+        d_deterministic = true;
+        d_entities.keep_sorted();
+        std::apply([](auto&... sets) { (sets.keep_sorted(), ...); }, d_components);
+        std::ranges::sort(d_pool, {}, apx::to_index);
+    }
+
+    // Goes back to reusing the oldest destroyed index and swapping in the back element
+    // to fill the gaps left by erased ones.
+    void disable_deterministic()
+    {
+        d_deterministic = false;
+        d_entities.keep_sorted(false);
+        std::apply([](auto&... sets) { (sets.keep_sorted(false), ...); }, d_components);
+    }
+
+    [[nodiscard]] bool is_deterministic() const noexcept
+    {
+        return d_deterministic;
+    }
+
+    // Starts maintaining a checksum of the registry, which is the same for two
+    // registries with the same entities and components, regardless of their storage
+    // order. It is computed once here, then kept up to date as entities and components
+    // come and go, and as components change through patch, so comparing it between
+    // worlds each tick is cheap. Components changed in any other way are missed, so
+    // recompute it with another call to this afterwards. See apx::component_hash.
+    void enable_checksum()
+    {
+        static_assert((apx::hashable_component<Comps> && ...), "specialise apx::component_hash for every component");
+        d_checksum = 0;
+        for (const apx::entity entity : all()) {
+            hash_in(entity);
+        }
+        apx::meta::for_each(tags, [&] <typename T> (apx::meta::tag<T>) {
+            for (const auto [entity, component] : get_comps<T>().each()) {
+                hash_in(entity, component);
+            }
+        });
+    }
+
+    void disable_checksum() noexcept
+    {
+        d_checksum.reset();
+    }
+
+    // Returns the checksum, see enable_checksum.
+    [[nodiscard]] std::uint64_t checksum() const noexcept
+    {
+        assert(d_checksum);
+        return *d_checksum;
+    }
+
+    // Reports every change made to the registry from now on to the given observer, until
+    // it is passed to unobserve. Changes undone by rollback_to are reported as the
+    // opposite change, so that observers never see the journal. Copies of the registry
+    // are not observed, though they do take everything else with them, so a copy can be
+    // rolled back with its own journal and keeps the orders of view_sorted.
+    void observe(apx::observer& o)
+    {
+        d_observers.add(o);
+    }
+
+    void unobserve(apx::observer& o)
+    {
+        d_observers.remove(o);
+    }
+
+    // Starts a journal of the changes made to the registry, which rollback_to uses to
+    // undo them. Changes are grouped by the tick given to begin_tick, and only the given
+    // number of most recent ticks are kept, the oldest being forgotten as each new one
+    // begins. Changes made before the first tick begins are not recorded.
+    void enable_journal(const std::size_t ticks)
+    {
+        assert(ticks > 0);
+        d_journal_capacity = ticks;
+        while (d_journal.size() > d_journal_capacity) {
+            d_journal.pop_front();
+        }
+    }
+
+    void disable_journal() noexcept
+    {
+        d_journal_capacity = 0;
+        d_journal.clear();
+    }
+
+    // Records the changes from now on as made during the given tick, which must be later
+    // than the previous one.
+    void begin_tick(const std::uint64_t tick)
+    {
+        if (d_journal_capacity == 0) {
+            return;
+        }
+        assert(d_journal.empty() || d_journal.back().tick < tick);
+
+        // Reuse the memory of the tick that is being forgotten.
+        journal_tick log;
+        if (d_journal.size() == d_journal_capacity) {
+            log = std::move(d_journal.front());
+            d_journal.pop_front();
+            log.clear();
         }
+        log.tick = tick;
+        d_journal.push_back(std::move(log));
+    }
+
+    // Restores the registry to how it was when the given tick began, by undoing every
+    // change recorded since in reverse, which also restores the order of the component
+    // storage unless it has been sorted since. The undone ticks are removed from the
+    // journal. Returns false and changes nothing if the tick is older than the journal.
+    bool rollback_to(const std::uint64_t tick)
+    {
+        if (d_journal.empty() || d_journal.front().tick > tick) {
+            return false;
+        }
+
+        using kind = typename journal_entry::kind;
+        while (!d_journal.empty() && d_journal.back().tick >= tick) {
+            journal_tick& log = d_journal.back();
+            for (auto entry = log.entries.rbegin(); entry != log.entries.rend(); ++entry) {
+                const auto [index, version] = apx::split(entry->entity);
+                if (entry->what == kind::create) {
+                    notify_destroy(entry->entity);
+                    d_entities.erase(index);
+                    if (entry->position != 0) {
+                        return_to_pool(apx::combine(index, version - 1), true);
+                    }
+                } else if (entry->what == kind::destroy) {
+                    unreturn_to_pool(entry->entity);
+                    d_entities.restore(index, entry->entity, entry->position);
+                    notify_create(entry->entity);
+                } else {
+                    undo_component[entry->component](*this, log, *entry);
+                }
+            }
+            d_journal.pop_back();
+        }
+        return true;
     }
 
     void remove_all_components(apx::entity entity)
@@ -346,29 +2595,29 @@ public:
     template <typename Comp>
     [[nodiscard]] bool has(const apx::entity entity) const noexcept
     {
-        static_assert(apx::meta::tuple_contains_v<apx::sparse_set<Comp>, tuple_type>);
+        static_assert(apx::meta::tuple_contains_v<apx::sparse_set<Comp, apx::entity>, tuple_type>);
         assert(valid(entity));
         return get_comps<Comp>().has(apx::to_index(entity));
     }
 
-    template <typename... Comps>
+    template <typename... Ts>
     [[nodiscard]] bool has_all(const apx::entity entity) const noexcept
     {
         assert(valid(entity));
-        return (has<Comps>(entity) && ...);
+        return (has<Ts>(entity) && ...);
     }
 
-    template <typename... Comps>
+    template <typename... Ts>
     [[nodiscard]] bool has_any(const apx::entity entity) const noexcept
     {
         assert(valid(entity));
-        return (has<Comps>(entity) || ...);
+        return (has<Ts>(entity) || ...);
     }
 
     template <typename Comp>
     [[nodiscard]] Comp& get(const apx::entity entity) noexcept
     {
-        static_assert(apx::meta::tuple_contains_v<apx::sparse_set<Comp>, tuple_type>);
+        static_assert(apx::meta::tuple_contains_v<apx::sparse_set<Comp, apx::entity>, tuple_type>);
         assert(has<Comp>(entity));
         return get_comps<Comp>()[apx::to_index(entity)];
     }
@@ -376,30 +2625,84 @@ public:
     template <typename Comp>
     [[nodiscard]] const Comp& get(const apx::entity entity) const noexcept
     {
-        static_assert(apx::meta::tuple_contains_v<apx::sparse_set<Comp>, tuple_type>);
+        static_assert(apx::meta::tuple_contains_v<apx::sparse_set<Comp, apx::entity>, tuple_type>);
         assert(has<Comp>(entity));
         return get_comps<Comp>()[apx::to_index(entity)];
     }
 
-    template <typename... Comps>
+    template <typename... Ts>
     [[nodiscard]] auto get_all(const apx::entity entity) noexcept
     {
-        assert(has_all<Comps...>(entity));
-        return std::make_tuple(std::ref(get<Comps>(entity))...);
+        assert(has_all<Ts...>(entity));
+        return std::make_tuple(std::ref(get<Ts>(entity))...);
     }
 
-    template <typename... Comps>
+    template <typename... Ts>
     [[nodiscard]] auto get_all(const apx::entity entity) const noexcept
     {
-        assert(has_all<Comps...>(entity));
-        return std::make_tuple(std::cref(get<Comps>(entity))...);
+        assert(has_all<Ts...>(entity));
+        return std::make_tuple(std::cref(get<Ts>(entity))...);
+    }
+
+    // Copies the given components of each of the entities, which must have them all,
+    // into the matching position of the output arrays, so that work on an arbitrary list
+    // of entities can run over dense arrays. See scatter for writing them back.
+    template <typename... Ts>
+    void gather(const std::span<const apx::entity> entities, const std::span<Ts>... out) const
+    {
+        assert(valid(entities));
+        assert(((out.size() >= entities.size()) && ...));
+        (resolve(get_comps<Ts>(), entities, [dst = out.data()](std::size_t i, const Ts& component) { dst[i] = component; }), ...);
+    }
+
+    // Copies each position of the input arrays into the given components of the
+    // matching entity, which must have them all. The inverse of gather.
+    template <typename... Ts>
+    void scatter(const std::span<const apx::entity> entities, const std::span<const Ts>... in)
+    {
+        assert(valid(entities));
+        assert(((in.size() >= entities.size()) && ...));
+        (resolve(get_comps<Ts>(), entities, [src = in.data()](std::size_t i, Ts& component) { component = src[i]; }), ...);
     }
 
     template <typename Comp>
     [[nodiscard]] Comp* get_if(const apx::entity entity) noexcept
     {
-        static_assert(apx::meta::tuple_contains_v<apx::sparse_set<Comp>, tuple_type>);
-        return has<Comp>(entity) ? &get<Comp>(entity) : nullptr;
+        static_assert(apx::meta::tuple_contains_v<apx::sparse_set<Comp, apx::entity>, tuple_type>);
+        assert(valid(entity));
+        return get_comps<Comp>().find(apx::to_index(entity));
+    }
+
+    // The storage of the given component, for serialising it. The entities are in its
+    // keys, and their components at the same positions in its values.
+    template <typename Comp>
+    [[nodiscard]] const apx::sparse_set<Comp, apx::entity>& storage() const noexcept
+    {
+        static_assert(apx::meta::tuple_contains_v<apx::sparse_set<Comp, apx::entity>, tuple_type>);
+        return get_comps<Comp>();
+    }
+
+    // The destroyed entities waiting to be reused, in the order they will be reused. In
+    // deterministic mode this is by index.
+    [[nodiscard]] const std::deque<apx::entity>& pool() const noexcept
+    {
+        return d_pool;
+    }
+
+    // Clears the registry and replaces its entities with the given live ones, in the
+    // order all() should visit them, and its pool of destroyed ones, as given by pool().
+    // Together with storage() this lets a registry be saved and restored exactly.
+    void assign(const std::span<const apx::entity> entities, const std::span<const apx::entity> pool)
+    {
+        clear();
+        for (const apx::entity entity : entities) {
+            d_entities.insert(apx::to_index(entity), entity);
+            notify_create(entity);
+        }
+        d_pool.assign(pool.begin(), pool.end());
+        if (d_deterministic) {
+            std::ranges::sort(d_pool, {}, apx::to_index);
+        }
     }
 
     apx::entity from_index(std::size_t index) const noexcept
@@ -412,39 +2715,244 @@ public:
         return d_entities.each() | std::views::values;
     }
 
-    template <typename... Comps>
+    template <typename... Ts>
     [[nodiscard]] auto view() const noexcept
     {
-        if constexpr (sizeof...(Comps) == 0) {
+        if constexpr (sizeof...(Ts) == 0) {
             return all();
+        } else if constexpr (sizeof...(Ts) == 1) {
+            return get_comps<Ts...>().keys();
         } else {
-            using Comp = typename apx::meta::get_first<Comps...>::type;
-            const auto entity_view = get_comps<Comp>().each() 
-                | std::views::keys
-                | std::views::transform([&](auto index) { return from_index(index); });
-
-            if constexpr (sizeof...(Comps) > 1) {
-                return entity_view | std::views::filter([&](auto entity) {
-                    return has_all<Comps...>(entity);
-                });
-            } else {
-                return entity_view;
-            }
+            return apx::join_view<const Ts...>(get_comps<Ts>()...);
+        }
+    }
+
+    // The id of the given component type, for building runtime views.
+    template <typename Comp>
+    [[nodiscard]] static constexpr apx::component_id id_of() noexcept
+    {
+        static_assert(apx::meta::tuple_contains_v<apx::sparse_set<Comp, apx::entity>, tuple_type>);
+        return apx::meta::index_of<Comp, Comps...>();
+    }
+
+    // Returns a view over the entities that have every component with the given ids.
+    // The iterator's component(k) gives a pointer to the component with the k'th id,
+    // which the caller casts back to its type.
+    [[nodiscard]] apx::runtime_view runtime_view(const std::span<const apx::component_id> ids)
+    {
+        std::vector<apx::runtime_view::column> cols;
+        cols.reserve(ids.size());
+        for (const apx::component_id id : ids) {
+            assert(id < sizeof...(Comps));
+            cols.push_back(columns[id](*this));
+        }
+        return apx::runtime_view{std::move(cols)};
+    }
+
+    [[nodiscard]] apx::runtime_view runtime_view(const std::initializer_list<apx::component_id> ids)
+    {
+        return runtime_view(std::span<const apx::component_id>{ids.begin(), ids.size()});
+    }
+
+    // Yields a tuple of references to the given components of every entity that has them
+    // all. Components wrapped in apx::optional do not filter the entities, and are
+    // yielded as pointers that are null for entities without them.
+    template <typename... Ts> [[nodiscard]] auto view_get() noexcept
+    {
+        if constexpr (sizeof...(Ts) == 1 && !(apx::meta::is_optional_v<Ts> || ...)) {
+            return get_comps<Ts...>().values() | std::views::transform([](auto& component) {
+                return std::tuple<Ts&...>{component};
+            });
+        } else {
+            return apx::join_view<Ts...>(get_comps<apx::meta::component_t<Ts>>()...).components();
+        }
+    }
+
+    template <typename... Ts> [[nodiscard]] auto view_get() const noexcept
+    {
+        if constexpr (sizeof...(Ts) == 1 && !(apx::meta::is_optional_v<Ts> || ...)) {
+            return get_comps<Ts...>().values() | std::views::transform([](const auto& component) {
+                return std::tuple<const Ts&...>{component};
+            });
+        } else {
+            return apx::join_view<const Ts...>(get_comps<apx::meta::component_t<Ts>>()...).components();
         }
     }
 
-    template <typename... Comps> [[nodiscard]] auto view_get() noexcept
+    // Maintains a bitmap of the entities that have the given component, which views
+    // over several components that all have one use to intersect them. See
+    // apx::sparse_set::enable_bitmap.
+    template <typename Comp>
+    void enable_bitmap()
+    {
+        static_assert(apx::meta::tuple_contains_v<apx::sparse_set<Comp, apx::entity>, tuple_type>);
+        get_comps<Comp>().enable_bitmap();
+    }
+
+    template <typename Comp>
+    void disable_bitmap()
+    {
+        static_assert(apx::meta::tuple_contains_v<apx::sparse_set<Comp, apx::entity>, tuple_type>);
+        get_comps<Comp>().disable_bitmap();
+    }
+
+    // Returns the entities with the given component ordered by key(component), without
+    // moving the component storage. The order is kept between calls and brought up to
+    // date incrementally: entities that have lost the component are dropped, new ones
+    // are appended, and then the order is repaired with an insertion sort, which is
+    // linear when the keys have changed little. If the repair turns out to need too
+    // many moves, the order is sorted from scratch instead. Ties keep their previous
+    // order. An order is kept for each type of key function, so lambdas each have
+    // their own, but function pointers of the same type, or copies of a lambda that
+    // capture different state, share one and each call repairs it from the last. The
+    // returned span is valid until the next call for the same component and key.
+    template <typename Comp, typename KeyFn>
+    [[nodiscard]] std::span<const apx::entity> view_sorted(KeyFn key)
     {
-        return view<Comps...>() | std::views::transform([&](auto entity) {
-            return get_all<Comps...>(entity);
+        static_assert(apx::meta::tuple_contains_v<apx::sparse_set<Comp, apx::entity>, tuple_type>);
+        using key_type = std::remove_cvref_t<std::invoke_result_t<KeyFn&, const Comp&>>;
+
+        const auto& set = get_comps<Comp>();
+        auto& views = d_sorted_views[id_of<Comp>()];
+        const char* const key_fn = &apx::meta::type_id<KeyFn>::value;
+        auto view = std::ranges::find(views, key_fn, &sorted_view::key_fn);
+        if (view == views.end()) {
+            view = views.insert(views.end(), {key_fn, {}});
+        }
+        auto& order = view->entities;
+
+        // Keep the entities that still have the component, marking their positions in
+        // the packed arrays so that the rest can be appended as new.
+        auto& seen = d_sorted_seen;
+        seen.assign(set.size(), false);
+        std::erase_if(order, [&](const apx::entity e) {
+            const apx::index_t index = apx::to_index(e);
+            if (!set.has(index) || set.key(index) != e) {
+                return true;
+            }
+            seen[set.sparse()[index]] = true;
+            return false;
         });
+        for (std::size_t pos = 0; pos != seen.size(); ++pos) {
+            if (!seen[pos]) {
+                order.push_back(set.keys()[pos]);
+            }
+        }
+
+        using keyed_type = std::vector<std::pair<key_type, apx::entity>>;
+        if (!view->keyed.has_value()) {
+            view->keyed.template emplace<keyed_type>();
+        }
+        auto& keyed = *std::any_cast<keyed_type>(&view->keyed);
+        keyed.clear();
+        for (const apx::entity e : order) {
+            keyed.emplace_back(key(set[apx::to_index(e)]), e);
+        }
+
+        constexpr std::size_t moves_per_entity = 4;
+        std::size_t budget = moves_per_entity * keyed.size() + 64;
+        const auto less = [](const auto& a, const auto& b) { return a.first < b.first; };
+        for (std::size_t i = 1; i < keyed.size(); ++i) {
+            std::size_t j = i;
+            auto current = std::move(keyed[i]);
+            while (j > 0 && budget > 0 && less(current, keyed[j - 1])) {
+                keyed[j] = std::move(keyed[j - 1]);
+                --j;
+                --budget;
+            }
+            keyed[j] = std::move(current);
+            if (budget == 0) {
+                std::ranges::stable_sort(keyed, less);
+                break;
+            }
+        }
+
+        std::ranges::transform(keyed, order.begin(), [](const auto& k) { return k.second; });
+        return order;
+    }
+
+    // Sorts the storage of the given component by entity index, which allows views over
+    // it to use a merge join. See apx::sparse_set::sort.
+    template <typename Comp>
+    void sort()
+    {
+        static_assert(apx::meta::tuple_contains_v<apx::sparse_set<Comp, apx::entity>, tuple_type>);
+        get_comps<Comp>().sort();
+    }
+
+    // Folds map(components...) for every entity with the given components into init
+    // with combine. The work is split into parts that are reduced separately, on as
+    // many threads as the options ask for, and then combined in order, so combine
+    // should be associative and map safe to call from several threads at once. Over a
+    // single component, each part is a plain loop over its packed values.
+    template <typename... Ts, typename T, typename Map, typename Combine>
+    [[nodiscard]] T reduce(T init, Map map, Combine combine, const apx::reduce_options& options = {}) const
+    {
+        auto partial = reduce_partial<Ts...>(map, combine, options);
+        return partial ? combine(std::move(init), std::move(*partial)) : init;
+    }
+
+    template <typename... Ts, typename Map>
+    [[nodiscard]] auto sum(Map map, const apx::reduce_options& options = {}) const
+    {
+        using result_type = std::remove_cvref_t<std::invoke_result_t<Map&, const Ts&...>>;
+        return reduce<Ts...>(result_type{}, std::move(map), std::plus<>{}, options);
     }
 
-    template <typename... Comps> [[nodiscard]] auto view_get() const noexcept
+    // Returns the least map(components...) over the entities with the given components,
+    // or an empty optional if there are none.
+    template <typename... Ts, typename Map>
+    [[nodiscard]] auto min(Map map, const apx::reduce_options& options = {}) const
     {
-        return view<Comps...>() | std::views::transform([&](auto entity) {
-            return get_all<Comps...>(entity);
+        auto combine = [](auto a, auto b) { return b < a ? b : a; };
+        return reduce_partial<Ts...>(map, combine, options);
+    }
+
+    template <typename... Ts, typename Map>
+    [[nodiscard]] auto max(Map map, const apx::reduce_options& options = {}) const
+    {
+        auto combine = [](auto a, auto b) { return a < b ? b : a; };
+        return reduce_partial<Ts...>(map, combine, options);
+    }
+
+    // Returns the number of entities with all the given components.
+    template <typename... Ts>
+    [[nodiscard]] std::size_t count(const apx::reduce_options& options = {}) const
+    {
+        if constexpr (sizeof...(Ts) == 1) {
+            return get_comps<Ts...>().size();
+        } else {
+            return reduce<Ts...>(std::size_t{0}, [](const Ts&...) { return std::size_t{1}; }, std::plus<>{}, options);
+        }
+    }
+
+    // As reduce, but reduces the entities separately for each distinct value of
+    // key(components...), and returns the result for each key.
+    template <typename... Ts, typename Key, typename Map, typename Combine>
+    [[nodiscard]] auto group_by(Key key, Map map, Combine combine, const apx::reduce_options& options = {}) const
+    {
+        using key_type = std::remove_cvref_t<std::invoke_result_t<Key&, const Ts&...>>;
+        using result_type = std::remove_cvref_t<std::invoke_result_t<Map&, const Ts&...>>;
+        using groups_type = std::unordered_map<key_type, result_type>;
+
+        const auto add = [&](groups_type& groups, key_type&& k, result_type&& value) {
+            if (auto [it, inserted] = groups.try_emplace(std::move(k), std::move(value)); !inserted) {
+                it->second = combine(std::move(it->second), std::move(value));
+            }
+        };
+
+        auto groups = apx::detail::parallel_reduce<groups_type>(driving_size<Ts...>(), options, [&](std::size_t first, std::size_t last) {
+            std::optional<groups_type> part{std::in_place};
+            for_each_in<Ts...>(first, last, [&](const Ts&... components) {
+                add(*part, key(components...), map(components...));
+            });
+            return part;
+        }, [&](groups_type& into, groups_type&& from) {
+            for (auto& [k, value] : from) {
+                add(into, key_type{k}, std::move(value));
+            }
         });
+        return groups ? std::move(*groups) : groups_type{};
     }
 
     template <typename... Ts>
@@ -454,10 +2962,10 @@ public:
         destroy(to_delete);
     }
 
-    template <typename... Comps>
+    template <typename... Ts>
     [[nodiscard]] apx::entity find(const predicate_t& predicate = [](apx::entity) { return true; }) const noexcept
     {
-        auto v = view<Comps...>();
+        auto v = view<Ts...>();
         if (auto result = std::ranges::find_if(v, predicate); result != v.end()) {
             return *result;
         }
@@ -470,8 +2978,8 @@ apx::entity copy(apx::entity entity, const apx::registry<Comps...>& src, apx::re
 {
     auto new_entity = dst.create();
     apx::meta::for_each(apx::registry<Comps...>::tags, [&]<typename T>(apx::meta::tag<T>) {
-        if (src.has<T>(entity)) {
-            dst.add<T>(new_entity, src.get<T>(entity));
+        if (src.template has<T>(entity)) {
+            dst.template add<T>(new_entity, src.template get<T>(entity));
         }
     });
     return new_entity;
@@ -0,0 +1,397 @@
+#ifndef APECS_CHECKPOINT_HPP_
+#define APECS_CHECKPOINT_HPP_
+
+#include <apecs/apecs.hpp>
+#include <apecs/serialize.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define APECS_HAS_FORK 1
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace apx {
+
+// How checkpoint_async saves the registry. A forked child process writes out a copy of
+// the registry that the kernel shares with the parent until either writes to a page,
+// so the parent only pays for the fork itself, which is proportional to the size of
+// its page tables. Blocking saves it on the calling thread, which is the fallback
+// where there is no fork, or it fails.
+enum class checkpoint_mode { fork, blocking };
+
+enum class checkpoint_status { running, done, failed };
+
+namespace detail {
+
+inline constexpr std::uint32_t checkpoint_magic = 0x43585041; // "APXC"
+inline constexpr std::uint32_t checkpoint_version = 2;
+
+// Writes a file through a buffer of its own, without allocating, so that a forked child
+// of a multithreaded process can use it: only the thread that forked exists in the
+// child, and any lock held by another, such as the allocator's, stays held forever.
+class checkpoint_writer
+{
+    std::array<std::byte, std::size_t{1} << 16> d_buffer;
+    std::size_t                                 d_used = 0;
+    bool                                        d_ok = true;
+
+#ifdef APECS_HAS_FORK
+    int d_fd;
+
+    void write_out(const std::byte* data, std::size_t size)
+    {
+        while (size != 0 && d_ok) {
+            const ::ssize_t written = ::write(d_fd, data, size);
+            if (written < 0) {
+                d_ok = errno == EINTR;
+                continue;
+            }
+            data += written;
+            size -= static_cast<std::size_t>(written);
+        }
+    }
+
+public:
+    explicit checkpoint_writer(const char* path)
+        : d_fd{::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)}
+    {
+        d_ok = d_fd >= 0;
+    }
+
+    // Flushes the buffer and syncs the file to disk, returning true if it was all written.
+    bool finish()
+    {
+        flush();
+        if (d_fd >= 0) {
+            d_ok = ::fsync(d_fd) == 0 && d_ok;
+            d_ok = ::close(d_fd) == 0 && d_ok;
+            d_fd = -1;
+        }
+        return d_ok;
+    }
+#else
+    std::FILE* d_file;
+
+    void write_out(const std::byte* data, const std::size_t size)
+    {
+        d_ok = d_ok && std::fwrite(data, 1, size, d_file) == size;
+    }
+
+public:
+    explicit checkpoint_writer(const char* path)
+        : d_file{std::fopen(path, "wb")}
+    {
+        d_ok = d_file != nullptr;
+    }
+
+    bool finish()
+    {
+        flush();
+        if (d_file) {
+            d_ok = std::fclose(d_file) == 0 && d_ok;
+            d_file = nullptr;
+        }
+        return d_ok;
+    }
+#endif
+
+    checkpoint_writer(const checkpoint_writer&) = delete;
+    checkpoint_writer& operator=(const checkpoint_writer&) = delete;
+
+    ~checkpoint_writer()
+    {
+        finish();
+    }
+
+    void flush()
+    {
+        write_out(d_buffer.data(), d_used);
+        d_used = 0;
+    }
+
+    void bytes(const void* data, const std::size_t size)
+    {
+        if (size == 0) {
+            return;
+        }
+        const auto* first = static_cast<const std::byte*>(data);
+        if (d_used + size > d_buffer.size()) {
+            flush();
+            if (size > d_buffer.size()) {
+                write_out(first, size);
+                return;
+            }
+        }
+        std::memcpy(d_buffer.data() + d_used, first, size);
+        d_used += size;
+    }
+
+    template <typename T>
+    void raw(const T& value)
+    {
+        bytes(&value, sizeof(T));
+    }
+};
+
+// Writes the registry to the file at tmp and then renames it to path, so that path only
+// ever holds a complete checkpoint. Safe to call in a forked child.
+template <typename... Comps>
+bool save_checkpoint(const apx::registry<Comps...>& reg, const char* tmp, const char* path, const std::uint64_t label)
+{
+    static_assert((std::is_trivially_copyable_v<Comps> && ...), "checkpoints hold components as their bytes");
+
+    checkpoint_writer out{tmp};
+    out.raw(checkpoint_magic);
+    out.raw(checkpoint_version);
+    out.raw(label);
+    out.raw(static_cast<std::uint32_t>(sizeof...(Comps)));
+    (out.raw(static_cast<std::uint32_t>(sizeof(Comps))), ...);
+
+    out.raw(static_cast<std::uint64_t>(reg.size()));
+    for (const apx::entity entity : reg.all()) {
+        out.raw(entity);
+    }
+    out.raw(static_cast<std::uint64_t>(reg.pool().size()));
+    for (const apx::entity entity : reg.pool()) {
+        out.raw(entity);
+    }
+
+    const auto write_set = [&](const auto& set) {
+        out.raw(static_cast<std::uint64_t>(set.size()));
+        out.bytes(set.keys().data(), set.keys().size_bytes());
+        out.bytes(set.values().data(), set.values().size_bytes());
+    };
+    (write_set(reg.template storage<Comps>()), ...);
+
+    if (out.finish() && std::rename(tmp, path) == 0) {
+        return true;
+    }
+    std::remove(tmp);
+    return false;
+}
+
+// A file name next to path to write a checkpoint to before renaming it into place. It
+// is different for every call, and every process, so that saves to the same path that
+// overlap, say a forked one still running when the next starts, each write their own
+// file and the last to finish wins.
+inline std::string checkpoint_temp_path(const std::string& path)
+{
+    static std::atomic<std::uint64_t> counter{0};
+    std::string tmp = path + ".tmp.";
+#ifdef APECS_HAS_FORK
+    tmp += std::to_string(::getpid()) + ".";
+#endif
+    return tmp + std::to_string(counter.fetch_add(1, std::memory_order_relaxed));
+}
+
+}
+
+// A checkpoint being written by checkpoint_async.
+class checkpoint
+{
+    checkpoint_status d_status;
+#ifdef APECS_HAS_FORK
+    ::pid_t d_child = -1;
+#endif
+
+public:
+    explicit checkpoint(const checkpoint_status status) : d_status{status} {}
+
+#ifdef APECS_HAS_FORK
+    explicit checkpoint(const ::pid_t child) : d_status{checkpoint_status::running}, d_child{child} {}
+#endif
+
+    checkpoint(checkpoint&& other) noexcept
+        : d_status{other.d_status}
+#ifdef APECS_HAS_FORK
+        , d_child{std::exchange(other.d_child, -1)}
+#endif
+    {}
+
+    checkpoint& operator=(checkpoint&& other) noexcept
+    {
+        if (this != &other) {
+            wait();
+            d_status = other.d_status;
+#ifdef APECS_HAS_FORK
+            d_child = std::exchange(other.d_child, -1);
+#endif
+        }
+        return *this;
+    }
+
+    // Waits for the checkpoint, so that the child process does not outlive the handle.
+    ~checkpoint()
+    {
+        wait();
+    }
+
+    // Returns whether the checkpoint has finished, without waiting for it.
+    checkpoint_status poll()
+    {
+        return reap(false);
+    }
+
+    checkpoint_status wait()
+    {
+        return reap(true);
+    }
+
+private:
+    checkpoint_status reap([[maybe_unused]] const bool block)
+    {
+#ifdef APECS_HAS_FORK
+        if (d_status == checkpoint_status::running && d_child > 0) {
+            int status = 0;
+            ::pid_t reaped = 0;
+            do {
+                reaped = ::waitpid(d_child, &status, block ? 0 : WNOHANG);
+            } while (reaped < 0 && errno == EINTR);
+            if (reaped == d_child) {
+                const bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+                d_status = ok ? checkpoint_status::done : checkpoint_status::failed;
+                d_child = -1;
+            } else if (reaped < 0) {
+                d_status = checkpoint_status::failed;
+                d_child = -1;
+            }
+        }
+#endif
+        return d_status;
+    }
+};
+
+// Saves every entity and component of the registry to the given file, replacing it
+// once the new checkpoint is complete. Returns true on success. The label is kept in
+// the file for checkpoint_label to read back, and is otherwise unused.
+template <typename... Comps>
+bool save_checkpoint(const apx::registry<Comps...>& reg, const std::string& path, const std::uint64_t label = 0)
+{
+    const std::string tmp = apx::detail::checkpoint_temp_path(path);
+    return apx::detail::save_checkpoint(reg, tmp.c_str(), path.c_str(), label);
+}
+
+// Starts saving the registry as save_checkpoint does, and returns a handle to poll for
+// its completion. By default this forks, so the registry can go on being changed at
+// once; the checkpoint holds it as it was at the time of the call. Without fork, or if
+// it fails, this saves the registry before returning.
+template <typename... Comps>
+apx::checkpoint checkpoint_async(const apx::registry<Comps...>& reg, const std::string& path, const checkpoint_mode mode = checkpoint_mode::fork, const std::uint64_t label = 0)
+{
+    const std::string tmp = apx::detail::checkpoint_temp_path(path);
+#ifdef APECS_HAS_FORK
+    if (mode == checkpoint_mode::fork) {
+        const ::pid_t child = ::fork();
+        if (child == 0) {
+            ::_exit(apx::detail::save_checkpoint(reg, tmp.c_str(), path.c_str(), label) ? 0 : 1);
+        }
+        if (child > 0) {
+            return apx::checkpoint{child};
+        }
+    }
+#endif
+    const bool ok = apx::detail::save_checkpoint(reg, tmp.c_str(), path.c_str(), label);
+    return apx::checkpoint{ok ? checkpoint_status::done : checkpoint_status::failed};
+}
+
+// Returns the label that the checkpoint in the given file was saved with, reading only
+// its header, or nullopt if there is no checkpoint there.
+inline std::optional<std::uint64_t> checkpoint_label(const std::string& path)
+{
+    std::ifstream file{path, std::ios::binary};
+    std::array<char, 2 * sizeof(std::uint32_t) + sizeof(std::uint64_t)> header{};
+    if (!file.read(header.data(), header.size())) {
+        return std::nullopt;
+    }
+    apx::byte_reader in{std::as_bytes(std::span{header})};
+    if (in.raw<std::uint32_t>() != apx::detail::checkpoint_magic || in.raw<std::uint32_t>() != apx::detail::checkpoint_version) {
+        return std::nullopt;
+    }
+    return in.raw<std::uint64_t>();
+}
+
+// Replaces the contents of the registry with the checkpoint in the given file, which
+// must have been saved from a registry of the same components. Returns false, leaving
+// the registry cleared, if the file cannot be read or does not match.
+template <typename... Comps>
+bool load_checkpoint(const std::string& path, apx::registry<Comps...>& reg)
+{
+    reg.clear();
+    std::ifstream file{path, std::ios::binary};
+    if (!file) {
+        return false;
+    }
+    std::vector<char> contents{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    apx::byte_reader in{std::as_bytes(std::span{contents})};
+
+    bool ok = in.raw<std::uint32_t>() == apx::detail::checkpoint_magic
+        && in.raw<std::uint32_t>() == apx::detail::checkpoint_version;
+    in.raw<std::uint64_t>();
+    ok = ok && in.raw<std::uint32_t>() == sizeof...(Comps);
+    ((ok = ok && in.raw<std::uint32_t>() == sizeof(Comps)), ...);
+    if (!ok) {
+        return false;
+    }
+
+    const auto read_entities = [&] {
+        std::vector<apx::entity> entities(in.raw<std::uint64_t>());
+        if (entities.size() > contents.size() / sizeof(apx::entity)) {
+            entities.clear();
+            return entities;
+        }
+        for (apx::entity& entity : entities) {
+            entity = in.raw<apx::entity>();
+        }
+        return entities;
+    };
+    const auto entities = read_entities();
+    const auto pool = read_entities();
+    if (!in.ok()) {
+        return false;
+    }
+    reg.assign(entities, pool);
+
+    const auto read_set = [&]<typename T>(apx::meta::tag<T>) {
+        const std::uint64_t count = in.raw<std::uint64_t>();
+        if (count > contents.size()) {
+            return false;
+        }
+        const std::byte* keys = in.bytes(count * sizeof(apx::entity));
+        const std::byte* values = in.bytes(count * sizeof(T));
+        for (std::uint64_t i = 0; in.ok() && i != count; ++i) {
+            apx::entity entity;
+            std::memcpy(&entity, keys + i * sizeof(apx::entity), sizeof(apx::entity));
+            if (!reg.valid(entity) || reg.template has<T>(entity)) {
+                return false;
+            }
+            std::array<std::byte, sizeof(T)> value;
+            std::memcpy(value.data(), values + i * sizeof(T), sizeof(T));
+            reg.template add<T>(entity, std::bit_cast<T>(value));
+        }
+        return in.ok();
+    };
+    ok = (read_set(apx::meta::tag<Comps>{}) && ...) && in.done();
+    if (!ok) {
+        reg.clear();
+    }
+    return ok;
+}
+
+}
+
+#endif // APECS_CHECKPOINT_HPP_
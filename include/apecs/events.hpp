@@ -0,0 +1,189 @@
+#ifndef APECS_EVENTS_HPP_
+#define APECS_EVENTS_HPP_
+
+#include <apecs/apecs.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace apx {
+
+// Where a reader of an event channel has got to, see event_channel::read. Each reader
+// keeps its own, so any number of them can see every event.
+template <typename Event>
+struct event_reader
+{
+    std::uint64_t frame = 0;
+    std::size_t   position = 0;
+};
+
+// Carries events of one type from the systems that send them to the systems that read
+// them a frame later, in place of components that are added for a frame and then
+// removed.
+//
+// Events are kept in two preallocated buffers. Those sent during a frame go into one,
+// each sender claiming a slot with a single atomic increment, so systems running on
+// several threads can send at once without locks. end_frame swaps the buffers, making
+// that frame's events readable for the next frame, and empties the other by resetting
+// its count, so nothing is allocated or destroyed per event. A frame that sends more
+// events than fit drops the rest, and end_frame grows the buffers for next time.
+template <typename Event>
+class event_channel
+{
+    static_assert(std::is_trivially_copyable_v<Event> && std::is_trivially_destructible_v<Event>,
+        "events are cleared by forgetting them");
+
+    std::array<std::vector<Event>, 2> d_buffers;
+
+    // The buffer being sent to, and the number of slots claimed in it, which can exceed
+    // its size if events were dropped.
+    std::size_t                       d_write = 0;
+    alignas(64) std::atomic<std::size_t> d_claimed = 0;
+    alignas(64) std::size_t           d_readable = 0;
+    std::uint64_t                     d_frame = 1;
+    std::size_t                       d_dropped = 0;
+
+public:
+    // Makes room for the given number of events per frame.
+    explicit event_channel(const std::size_t capacity = 1024)
+    {
+        for (auto& buffer : d_buffers) {
+            buffer.resize(std::max<std::size_t>(capacity, 1));
+        }
+    }
+
+    event_channel(const event_channel&) = delete;
+    event_channel& operator=(const event_channel&) = delete;
+
+    // Sends an event to be read next frame, returning false if the frame's buffer is
+    // full. Safe to call from several threads at once, but not during end_frame.
+    bool send(const Event& event) noexcept
+    {
+        auto& buffer = d_buffers[d_write];
+        const std::size_t slot = d_claimed.fetch_add(1, std::memory_order_relaxed);
+        if (slot >= buffer.size()) {
+            return false;
+        }
+        buffer[slot] = event;
+        return true;
+    }
+
+    // Sends the events with a single claim, returning how many of them fit. A system that
+    // sends many events is better off collecting them and sending them together, as
+    // each claim is an atomic operation that the threads sending contend on.
+    std::size_t send(const std::span<const Event> events) noexcept
+    {
+        auto& buffer = d_buffers[d_write];
+        const std::size_t first = d_claimed.fetch_add(events.size(), std::memory_order_relaxed);
+        if (first >= buffer.size()) {
+            return 0;
+        }
+        const std::size_t count = std::min(events.size(), buffer.size() - first);
+        std::copy_n(events.begin(), count, buffer.begin() + static_cast<std::ptrdiff_t>(first));
+        return count;
+    }
+
+    // Makes the events sent this frame readable in place of last frame's. Must be called
+    // once every sender has finished, which the join at the end of a parallel system
+    // ensures.
+    void end_frame()
+    {
+        const std::size_t claimed = d_claimed.load(std::memory_order_acquire);
+        const std::size_t capacity = d_buffers[d_write].size();
+        d_readable = std::min(claimed, capacity);
+        d_write ^= 1;
+        ++d_frame;
+        d_claimed.store(0, std::memory_order_relaxed);
+
+        // The readable buffer has to keep its events, so only the one to be sent to now
+        // can grow straight away; the other grows next frame.
+        if (claimed > capacity) {
+            d_dropped += claimed - capacity;
+        }
+        auto& next = d_buffers[d_write];
+        const std::size_t wanted = std::max(d_buffers[d_write ^ 1].size(), claimed);
+        if (next.size() < wanted) {
+            next.resize(std::max(wanted, 2 * next.size()));
+        }
+    }
+
+    // Returns the events sent last frame that the reader has not seen yet, and marks them
+    // as seen. Events are in the order their slots were claimed, which for events sent
+    // by several threads at once is arbitrary.
+    [[nodiscard]] std::span<const Event> read(event_reader<Event>& reader) const noexcept
+    {
+        if (reader.frame != d_frame) {
+            reader = {d_frame, 0};
+        }
+        const std::span<const Event> events{d_buffers[d_write ^ 1].data() + reader.position, d_readable - reader.position};
+        reader.position = d_readable;
+        return events;
+    }
+
+    // The events sent last frame, without a reader.
+    [[nodiscard]] std::span<const Event> events() const noexcept
+    {
+        return {d_buffers[d_write ^ 1].data(), d_readable};
+    }
+
+    // The number of events dropped because a frame's buffer was full.
+    [[nodiscard]] std::size_t dropped() const noexcept
+    {
+        return d_dropped;
+    }
+};
+
+// A channel for each of the given event types, see apx::event_channel.
+template <typename... Events>
+class event_bus
+{
+    std::tuple<event_channel<Events>...> d_channels;
+
+public:
+    // Constructs every channel in place with the given capacity, as they cannot be moved.
+    explicit event_bus(const std::size_t capacity = 1024)
+        : d_channels{(static_cast<void>(sizeof(Events)), capacity)...}
+    {}
+
+    template <typename Event>
+    [[nodiscard]] event_channel<Event>& channel() noexcept
+    {
+        static_assert(apx::meta::tuple_contains_v<event_channel<Event>, std::tuple<event_channel<Events>...>>);
+        return std::get<event_channel<Event>>(d_channels);
+    }
+
+    template <typename Event>
+    [[nodiscard]] const event_channel<Event>& channel() const noexcept
+    {
+        return std::get<event_channel<Event>>(d_channels);
+    }
+
+    template <typename Event>
+    bool send(const Event& event) noexcept
+    {
+        return channel<Event>().send(event);
+    }
+
+    template <typename Event>
+    [[nodiscard]] std::span<const Event> read(event_reader<Event>& reader) const noexcept
+    {
+        return channel<Event>().read(reader);
+    }
+
+    // Ends the frame for every channel.
+    void end_frame()
+    {
+        std::apply([](auto&... channels) { (channels.end_frame(), ...); }, d_channels);
+    }
+};
+
+}
+
+#endif // APECS_EVENTS_HPP_
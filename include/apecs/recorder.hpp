@@ -0,0 +1,429 @@
+#ifndef APECS_RECORDER_HPP_
+#define APECS_RECORDER_HPP_
+
+#include <apecs/apecs.hpp>
+#include <apecs/serialize.hpp>
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace apx {
+
+// The recorded components of one frame, as the entities that had each component and
+// the components at the same positions.
+template <typename... Ts>
+struct recorded_frame
+{
+    template <typename T>
+    struct column
+    {
+        std::vector<apx::entity> keys;
+        std::vector<T>           values;
+    };
+
+    std::uint64_t              number = 0;
+    std::tuple<column<Ts>...>  columns;
+
+    template <typename T>
+    [[nodiscard]] const column<T>& get() const noexcept
+    {
+        return std::get<column<T>>(columns);
+    }
+};
+
+// Records the given components of a registry every frame into a ring of compressed
+// frames, to be scrubbed through or restored afterwards.
+//
+// Capturing a frame copies each recorded column as it is into a spare buffer and hands
+// it to a background thread, so the simulation only pays for the copies. The thread
+// compresses each column against the same column of the frame before: if the same
+// entities have the component, only the bytes that changed are kept, as runs of the
+// XOR of the two frames. Every keyframe_interval frames is stored whole, and the ring
+// drops the oldest frames a keyframe's worth at a time, so that every frame it holds
+// can be decoded from the keyframe before it.
+template <typename Registry, typename... Ts>
+class recorder
+{
+    static_assert(sizeof...(Ts) > 0);
+    static_assert((std::is_trivially_copyable_v<Ts> && ...), "recorded components are kept as their bytes");
+
+    static constexpr std::size_t column_count = sizeof...(Ts);
+    static constexpr std::array<std::size_t, column_count> strides = {sizeof(Ts)...};
+
+    struct raw_column
+    {
+        std::vector<apx::entity> keys;
+        std::vector<std::byte>   values;
+    };
+
+    using raw_frame = std::array<raw_column, column_count>;
+
+    struct staged
+    {
+        std::uint64_t number = 0;
+        raw_frame     columns;
+    };
+
+    struct encoded_frame
+    {
+        std::uint64_t          number;
+        bool                   key;
+        std::vector<std::byte> data;
+    };
+
+    std::size_t d_capacity;
+    std::size_t d_keyframe_interval;
+
+    // Captures waiting for the thread, and spare buffers for more. The simulation never
+    // waits for the thread: if every buffer is in use, the frame is dropped.
+    mutable std::mutex          d_mutex;
+    std::condition_variable     d_wake;
+    std::condition_variable     d_idle;
+    std::deque<staged>          d_pending;
+    std::vector<staged>         d_spare;
+    bool                        d_busy = false;
+    bool                        d_stop = false;
+    std::uint64_t               d_next = 0;
+    std::size_t                 d_dropped = 0;
+
+    std::deque<encoded_frame>   d_ring;
+    std::size_t                 d_encoded_bytes = 0;
+
+    // Only used by the thread: the last frame captured, to compress the next against.
+    raw_frame                   d_previous;
+    std::optional<std::uint64_t> d_previous_number;
+
+    std::thread                 d_thread;
+
+    // Writes cur as runs of bytes equal to prev, which are skipped, and runs of the XOR
+    // of the two, which is mostly zero bits where values changed a little.
+    static void write_delta(apx::byte_writer& out, const std::span<const std::byte> cur, const std::span<const std::byte> prev)
+    {
+        constexpr std::size_t min_gap = 4;
+        std::size_t i = 0;
+        std::vector<std::byte> literal;
+        while (i != cur.size()) {
+            const std::size_t start = i;
+            while (i != cur.size() && cur[i] == prev[i]) {
+                ++i;
+            }
+            out.varint(i - start);
+
+            // The literal runs until a run of equal bytes long enough to be worth a gap.
+            literal.clear();
+            std::size_t equal = 0;
+            for (; i != cur.size() && equal < min_gap; ++i) {
+                equal = cur[i] == prev[i] ? equal + 1 : 0;
+                literal.push_back(cur[i] ^ prev[i]);
+            }
+            if (equal == min_gap) {
+                i -= equal;
+                literal.erase(literal.end() - static_cast<std::ptrdiff_t>(equal), literal.end());
+            }
+            out.varint(literal.size());
+            out.bytes(literal.data(), literal.size());
+        }
+    }
+
+    // Turns the bytes of the frame before into those of the frame written.
+    static bool read_delta(apx::byte_reader& in, const std::span<std::byte> values)
+    {
+        std::size_t i = 0;
+        while (in.ok() && i != values.size()) {
+            const std::uint64_t same = in.varint();
+            const std::uint64_t changed = in.varint();
+            if (same > values.size() - i || changed > values.size() - i - same) {
+                return false;
+            }
+            const std::byte* bytes = in.bytes(changed);
+            if (!in.ok()) {
+                return false;
+            }
+            i += same;
+            for (std::size_t k = 0; k != changed; ++k, ++i) {
+                values[i] ^= bytes[k];
+            }
+        }
+        return in.ok();
+    }
+
+    void encode(const staged& c, std::vector<std::byte>& out, const bool key) const
+    {
+        apx::byte_writer writer{out};
+        for (std::size_t k = 0; k != column_count; ++k) {
+            const raw_column& cur = c.columns[k];
+            const raw_column& prev = d_previous[k];
+            const bool delta = !key && cur.keys == prev.keys;
+            writer.varint(cur.keys.size());
+            writer.varint(delta);
+            if (delta) {
+                write_delta(writer, cur.values, prev.values);
+            } else {
+                writer.bytes(cur.keys.data(), cur.keys.size() * sizeof(apx::entity));
+                writer.bytes(cur.values.data(), cur.values.size());
+            }
+        }
+    }
+
+    // Decodes a frame given the frame before it, or nothing for a keyframe.
+    static bool decode(const encoded_frame& f, raw_frame& columns)
+    {
+        apx::byte_reader in{f.data};
+        for (std::size_t k = 0; k != column_count; ++k) {
+            raw_column& column = columns[k];
+            const std::uint64_t count = in.varint();
+            const bool delta = in.varint() != 0;
+            if (delta) {
+                if (count != column.keys.size() || !read_delta(in, column.values)) {
+                    return false;
+                }
+            } else {
+                const std::byte* keys = in.bytes(count * sizeof(apx::entity));
+                const std::byte* values = in.bytes(count * strides[k]);
+                if (!in.ok()) {
+                    return false;
+                }
+                column.keys.resize(count);
+                column.values.assign(values, values + count * strides[k]);
+                if (count != 0) {
+                    std::memcpy(column.keys.data(), keys, count * sizeof(apx::entity));
+                }
+            }
+        }
+        return in.ok();
+    }
+
+    void run()
+    {
+        std::unique_lock lock{d_mutex};
+        while (true) {
+            d_wake.wait(lock, [&] { return d_stop || !d_pending.empty(); });
+            if (d_pending.empty()) {
+                return;
+            }
+            staged c = std::move(d_pending.front());
+            d_pending.pop_front();
+            d_busy = true;
+            lock.unlock();
+
+            const bool key = !d_previous_number || c.number % d_keyframe_interval == 0 || *d_previous_number + 1 != c.number;
+            encoded_frame f{c.number, key, {}};
+            encode(c, f.data, key);
+            std::swap(d_previous, c.columns);
+            d_previous_number = c.number;
+
+            lock.lock();
+            d_encoded_bytes += f.data.size();
+            d_ring.push_back(std::move(f));
+
+            // Drop the oldest keyframe and the frames that depend on it while enough
+            // frames are left without them.
+            while (true) {
+                const auto next = std::ranges::find_if(d_ring.begin() + 1, d_ring.end(), &encoded_frame::key);
+                if (next == d_ring.end() || static_cast<std::size_t>(d_ring.end() - next) < d_capacity) {
+                    break;
+                }
+                while (d_ring.begin() != next) {
+                    d_encoded_bytes -= d_ring.front().data.size();
+                    d_ring.pop_front();
+                }
+            }
+            d_spare.push_back(std::move(c));
+            d_busy = false;
+            d_idle.notify_all();
+        }
+    }
+
+    // Returns the position in the ring of the given frame, or nullopt.
+    [[nodiscard]] std::optional<std::size_t> find(const std::uint64_t number) const
+    {
+        if (d_ring.empty() || number < d_ring.front().number || number > d_ring.back().number) {
+            return std::nullopt;
+        }
+        const auto it = std::ranges::lower_bound(d_ring, number, {}, &encoded_frame::number);
+        if (it == d_ring.end() || it->number != number) {
+            return std::nullopt;
+        }
+        return static_cast<std::size_t>(it - d_ring.begin());
+    }
+
+public:
+    // Keeps at least the given number of the most recent frames, and allows up to
+    // max_pending captures to wait for the background thread before dropping frames.
+    explicit recorder(const std::size_t capacity, const std::size_t keyframe_interval = 32, const std::size_t max_pending = 4)
+        : d_capacity{capacity}
+        , d_keyframe_interval{keyframe_interval}
+        , d_spare(max_pending)
+    {
+        assert(keyframe_interval > 0 && max_pending > 0);
+        d_thread = std::thread{[this] { run(); }};
+    }
+
+    recorder(const recorder&) = delete;
+    recorder& operator=(const recorder&) = delete;
+
+    // Finishes compressing the frames already captured.
+    ~recorder()
+    {
+        {
+            std::lock_guard lock{d_mutex};
+            d_stop = true;
+        }
+        d_wake.notify_one();
+        d_thread.join();
+    }
+
+    // Records the components of the registry as the next frame, returning false if it
+    // was dropped because the background thread has fallen behind.
+    bool capture(const Registry& reg)
+    {
+        std::unique_lock lock{d_mutex};
+        const std::uint64_t number = d_next++;
+        if (d_spare.empty()) {
+            ++d_dropped;
+            return false;
+        }
+        staged c = std::move(d_spare.back());
+        d_spare.pop_back();
+        lock.unlock();
+
+        c.number = number;
+        apx::meta::for_each(std::tuple<apx::meta::tag<Ts>...>{}, [&] <typename T> (apx::meta::tag<T>) {
+            const auto& set = reg.template storage<T>();
+            raw_column& column = c.columns[apx::meta::index_of<T, Ts...>()];
+            column.keys.assign(set.keys().begin(), set.keys().end());
+            const auto values = std::as_bytes(set.values());
+            column.values.assign(values.begin(), values.end());
+        });
+
+        lock.lock();
+        d_pending.push_back(std::move(c));
+        lock.unlock();
+        d_wake.notify_one();
+        return true;
+    }
+
+    // Waits for the background thread to compress every frame captured so far.
+    void flush()
+    {
+        std::unique_lock lock{d_mutex};
+        d_idle.wait(lock, [&] { return d_pending.empty() && !d_busy; });
+    }
+
+    // The oldest and newest frames held, if any. Frames in between may be missing if
+    // they were dropped.
+    [[nodiscard]] std::optional<std::pair<std::uint64_t, std::uint64_t>> frames() const
+    {
+        std::lock_guard lock{d_mutex};
+        if (d_ring.empty()) {
+            return std::nullopt;
+        }
+        return std::pair{d_ring.front().number, d_ring.back().number};
+    }
+
+    [[nodiscard]] bool contains(const std::uint64_t number) const
+    {
+        std::lock_guard lock{d_mutex};
+        return find(number).has_value();
+    }
+
+    // Returns the recorded components of the given frame, or nullopt if it is not held.
+    // This decodes every frame since the keyframe before it.
+    [[nodiscard]] std::optional<apx::recorded_frame<Ts...>> read(const std::uint64_t number) const
+    {
+        raw_frame columns;
+        {
+            std::lock_guard lock{d_mutex};
+            const auto position = find(number);
+            if (!position) {
+                return std::nullopt;
+            }
+            std::size_t first = *position;
+            while (!d_ring[first].key) {
+                --first;
+            }
+            for (std::size_t i = first; i <= *position; ++i) {
+                if (!decode(d_ring[i], columns)) {
+                    return std::nullopt;
+                }
+            }
+        }
+
+        apx::recorded_frame<Ts...> result;
+        result.number = number;
+        apx::meta::for_each(std::tuple<apx::meta::tag<Ts>...>{}, [&] <typename T> (apx::meta::tag<T>) {
+            raw_column& raw = columns[apx::meta::index_of<T, Ts...>()];
+            auto& column = std::get<typename apx::recorded_frame<Ts...>::template column<T>>(result.columns);
+            column.keys = std::move(raw.keys);
+            column.values.resize(raw.values.size() / sizeof(T));
+            std::ranges::copy(raw.values, reinterpret_cast<std::byte*>(column.values.data()));
+        });
+        return result;
+    }
+
+    // Sets the recorded components of the registry's entities to how they were in the
+    // given frame, adding and removing them as needed, through add, patch and remove so
+    // that the registry's journal and observers see the changes. Recorded entities
+    // that have since been destroyed are skipped. Returns false if the frame is not held.
+    bool restore(const std::uint64_t number, Registry& reg) const
+    {
+        const auto frame = read(number);
+        if (!frame) {
+            return false;
+        }
+        apx::meta::for_each(std::tuple<apx::meta::tag<Ts>...>{}, [&] <typename T> (apx::meta::tag<T>) {
+            const auto& column = frame->template get<T>();
+            std::vector<apx::entity> keys{column.keys};
+            std::ranges::sort(keys);
+            const auto current = reg.template storage<T>().keys();
+            std::vector<apx::entity> stale;
+            std::ranges::copy_if(current, std::back_inserter(stale), [&](apx::entity e) { return !std::ranges::binary_search(keys, e); });
+            for (const apx::entity e : stale) {
+                reg.template remove<T>(e);
+            }
+            for (std::size_t i = 0; i != column.keys.size(); ++i) {
+                const apx::entity e = column.keys[i];
+                if (!reg.valid(e)) {
+                    continue;
+                }
+                if (reg.template has<T>(e)) {
+                    reg.template patch<T>(e, [&](T& component) { component = column.values[i]; });
+                } else {
+                    reg.template add<T>(e, column.values[i]);
+                }
+            }
+        });
+        return true;
+    }
+
+    // The number of frames dropped because the background thread fell behind.
+    [[nodiscard]] std::size_t dropped() const
+    {
+        std::lock_guard lock{d_mutex};
+        return d_dropped;
+    }
+
+    // The memory taken by the compressed frames held.
+    [[nodiscard]] std::size_t encoded_bytes() const
+    {
+        std::lock_guard lock{d_mutex};
+        return d_encoded_bytes;
+    }
+};
+
+}
+
+#endif // APECS_RECORDER_HPP_
@@ -0,0 +1,225 @@
+#ifndef APECS_RELATIONS_HPP_
+#define APECS_RELATIONS_HPP_
+
+#include <apecs/apecs.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace apx {
+
+// Links between the entities of a registry, such as "targets" or "owned_by", given by
+// empty tag types. Each relation is many-to-many: a source may link to any number of
+// targets and a target be linked to from any number of sources.
+//
+// Every link is stored twice, in the targets of its source and the sources of its
+// target, and each copy knows where the other is. Asking which entities link to one is
+// then as cheap as asking which it links to, and removing a link takes constant time
+// however many others its endpoints have. When an entity is destroyed, every link to
+// and from it is removed with it.
+template <typename Registry, typename... Rels>
+class relations : public apx::observer
+{
+    static_assert(sizeof...(Rels) > 0);
+    static_assert((std::is_empty_v<Rels> && ...), "relations are named by empty tag types");
+
+    // The entities at the other end of an entity's links, and the position of each link
+    // in the other end's list.
+    struct adjacency
+    {
+        std::vector<apx::entity>   entities;
+        std::vector<std::uint32_t> positions;
+    };
+
+    struct storage
+    {
+        apx::sparse_set<adjacency, apx::entity> targets;
+        apx::sparse_set<adjacency, apx::entity> sources;
+        std::size_t                             size = 0;
+    };
+
+    Registry*                               d_registry;
+    std::array<storage, sizeof...(Rels)>    d_storage;
+
+    template <typename Rel>
+    [[nodiscard]] storage& storage_of() noexcept
+    {
+        return d_storage[apx::meta::index_of<Rel, Rels...>()];
+    }
+
+    template <typename Rel>
+    [[nodiscard]] const storage& storage_of() const noexcept
+    {
+        return d_storage[apx::meta::index_of<Rel, Rels...>()];
+    }
+
+    [[nodiscard]] static adjacency& adjacency_of(apx::sparse_set<adjacency, apx::entity>& set, const apx::entity entity)
+    {
+        const apx::index_t index = apx::to_index(entity);
+        if (!set.has(index)) {
+            return set.insert(entity, {});
+        }
+        return set[index];
+    }
+
+    [[nodiscard]] static std::span<const apx::entity> entities_of(const apx::sparse_set<adjacency, apx::entity>& set, const apx::entity entity)
+    {
+        const apx::index_t index = apx::to_index(entity);
+        if (!set.has(index) || set.key(index) != entity) {
+            return {};
+        }
+        return set[index].entities;
+    }
+
+    // Removes the entry at the given position of the entity's list by moving the last one
+    // into its place, and points the other end of the moved link at its new position.
+    static void erase_at(apx::sparse_set<adjacency, apx::entity>& set, apx::sparse_set<adjacency, apx::entity>& other, const apx::entity entity, const std::uint32_t position)
+    {
+        adjacency& list = set[apx::to_index(entity)];
+        const auto last = static_cast<std::uint32_t>(list.entities.size() - 1);
+        if (position != last) {
+            list.entities[position] = list.entities[last];
+            list.positions[position] = list.positions[last];
+            other[apx::to_index(list.entities[position])].positions[list.positions[position]] = position;
+        }
+        list.entities.pop_back();
+        list.positions.pop_back();
+        if (list.entities.empty()) {
+            set.erase(apx::to_index(entity));
+        }
+    }
+
+    // Removes the link at the given position of the source's targets.
+    static void unlink_at(storage& s, const apx::entity source, const std::uint32_t position)
+    {
+        const adjacency& targets = s.targets[apx::to_index(source)];
+        const apx::entity target = targets.entities[position];
+        const std::uint32_t back = targets.positions[position];
+        erase_at(s.sources, s.targets, target, back);
+        erase_at(s.targets, s.sources, source, position);
+        --s.size;
+    }
+
+    // Removes every link to and from the entity.
+    static void erase_links(storage& s, const apx::entity entity)
+    {
+        const apx::index_t index = apx::to_index(entity);
+        while (s.targets.has(index)) {
+            unlink_at(s, entity, static_cast<std::uint32_t>(s.targets[index].entities.size() - 1));
+        }
+        while (s.sources.has(index)) {
+            const adjacency& sources = s.sources[index];
+            unlink_at(s, sources.entities.back(), sources.positions.back());
+        }
+    }
+
+public:
+    // Attaches to the registry, to remove the links of entities destroyed in it.
+    explicit relations(Registry& reg)
+        : d_registry{&reg}
+    {
+        reg.observe(*this);
+    }
+
+    relations(const relations&) = delete;
+    relations& operator=(const relations&) = delete;
+
+    ~relations() override
+    {
+        d_registry->unobserve(*this);
+    }
+
+    void on_destroy(const apx::entity entity) override
+    {
+        for (storage& s : d_storage) {
+            erase_links(s, entity);
+        }
+    }
+
+    void on_clear() override
+    {
+        for (storage& s : d_storage) {
+            s.targets.clear();
+            s.sources.clear();
+            s.size = 0;
+        }
+    }
+
+    // Links the source to the target, returning false if it already was.
+    template <typename Rel>
+    bool link(const apx::entity source, const apx::entity target)
+    {
+        assert(d_registry->valid(source) && d_registry->valid(target));
+        if (linked<Rel>(source, target)) {
+            return false;
+        }
+        storage& s = storage_of<Rel>();
+        adjacency& targets = adjacency_of(s.targets, source);
+        adjacency& sources = adjacency_of(s.sources, target);
+        targets.entities.push_back(target);
+        targets.positions.push_back(static_cast<std::uint32_t>(sources.entities.size()));
+        sources.entities.push_back(source);
+        sources.positions.push_back(static_cast<std::uint32_t>(targets.entities.size() - 1));
+        ++s.size;
+        return true;
+    }
+
+    // Removes the link from the source to the target, returning false if there was none.
+    template <typename Rel>
+    bool unlink(const apx::entity source, const apx::entity target)
+    {
+        const auto targets = this->targets<Rel>(source);
+        const auto it = std::ranges::find(targets, target);
+        if (it == targets.end()) {
+            return false;
+        }
+        unlink_at(storage_of<Rel>(), source, static_cast<std::uint32_t>(it - targets.begin()));
+        return true;
+    }
+
+    // Removes every link of the relation to and from the entity.
+    template <typename Rel>
+    void unlink_all(const apx::entity entity)
+    {
+        erase_links(storage_of<Rel>(), entity);
+    }
+
+    // Returns true if the source links to the target. Takes time proportional to the
+    // number of targets of the source.
+    template <typename Rel>
+    [[nodiscard]] bool linked(const apx::entity source, const apx::entity target) const
+    {
+        const auto targets = this->targets<Rel>(source);
+        return std::ranges::find(targets, target) != targets.end();
+    }
+
+    // The entities that the source links to, and that link to the target, in no
+    // particular order. Changing the relation invalidates the spans.
+    template <typename Rel>
+    [[nodiscard]] std::span<const apx::entity> targets(const apx::entity source) const
+    {
+        return entities_of(storage_of<Rel>().targets, source);
+    }
+
+    template <typename Rel>
+    [[nodiscard]] std::span<const apx::entity> sources(const apx::entity target) const
+    {
+        return entities_of(storage_of<Rel>().sources, target);
+    }
+
+    // The number of links in the relation.
+    template <typename Rel>
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        return storage_of<Rel>().size;
+    }
+};
+
+}
+
+#endif // APECS_RELATIONS_HPP_
@@ -0,0 +1,483 @@
+#ifndef APECS_REPLICATION_HPP_
+#define APECS_REPLICATION_HPP_
+
+#include <apecs/apecs.hpp>
+#include <apecs/serialize.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace apx {
+
+// What it has cost to replicate to one consumer so far.
+struct replication_stats
+{
+    std::size_t              packets = 0;
+    std::size_t              bytes = 0;
+    std::size_t              last_bytes = 0;
+    std::size_t              records = 0;
+    std::chrono::nanoseconds encode_time{0};
+};
+
+namespace detail {
+
+// The kinds of record in a replication packet, each followed by the entity it is for.
+// An update is followed by a mask of the components it carries, in the order they were
+// given to the replicator, then a mask of those the entity no longer has, then the
+// carried components' bytes. Forgetting an entity means that it is no longer of
+// interest to the consumer rather than destroyed, though replicas treat both the same.
+enum class replication_op : std::uint8_t { update, forget, destroy };
+
+}
+
+// Replicates the given components of a registry's entities to any number of consumers,
+// each seeing the subset of entities that its interest function accepts. Each packet
+// made for a consumer holds only what has changed since the last packet it
+// acknowledged, so that a packet can be lost without the consumer falling out of sync,
+// and the cost of making one is proportional to the changes rather than the world.
+//
+// The replicator observes the registry, collecting the entities that changed during a
+// frame, which end_frame closes. As with the journal, only writes made through patch
+// are seen; touch() marks anything else. Interest is re-evaluated when an entity
+// changes, or for every entity when rescan() is called, say as a consumer moves.
+// The components are sent as their bytes, so the consumers must share the byte order.
+template <typename Registry, typename... Ts>
+class replicator : public apx::observer
+{
+public:
+    using consumer_id = std::size_t;
+    using interest_type = std::function<bool(const Registry&, apx::entity)>;
+
+private:
+    static_assert(sizeof...(Ts) > 0 && sizeof...(Ts) <= 64);
+    static_assert((std::is_trivially_copyable_v<Ts> && ...), "replicated components are sent as their bytes");
+
+    using mask_type = std::uint64_t;
+    using op = apx::detail::replication_op;
+
+    static constexpr mask_type all = sizeof...(Ts) == 64 ? ~mask_type{0} : (mask_type{1} << sizeof...(Ts)) - 1;
+
+    // The bit of each replicated component given its id in the registry, or zero.
+    static constexpr auto bit_of = [] {
+        std::array<mask_type, std::tuple_size_v<std::remove_const_t<decltype(Registry::tags)>>> bits{};
+        mask_type bit = 1;
+        ((bits[Registry::template id_of<Ts>()] = bit, bit <<= 1), ...);
+        return bits;
+    }();
+
+    // An entity that changed, with the components that changed. Creating or destroying
+    // an entity changes none.
+    struct change
+    {
+        apx::entity entity;
+        mask_type   mask;
+    };
+
+    struct frame
+    {
+        std::uint64_t       seq;
+        std::vector<change> changes;
+    };
+
+    // What a packet changed about which entities the consumer has.
+    struct in_flight
+    {
+        std::uint64_t            seq;
+        bool                     rescan;
+        std::vector<apx::entity> entered;
+        std::vector<apx::entity> left;
+    };
+
+    struct consumer
+    {
+        interest_type                   interest;
+        std::optional<std::uint64_t>    acked;
+        bool                            rescan = false;
+        std::unordered_set<apx::entity> known;  // as of the last acknowledged packet
+        std::deque<in_flight>           packets;
+        apx::replication_stats          stats;
+    };
+
+    Registry*                              d_registry;
+    std::vector<std::unique_ptr<consumer>> d_consumers;
+
+    // The closed frames that some consumer may still need, and the changes of the open
+    // one. Consumers that acknowledged a packet older than d_base need everything again.
+    std::deque<frame>   d_frames;
+    std::vector<change> d_open;
+    std::uint64_t       d_seq = 0;
+    std::uint64_t       d_base = 0;
+    std::size_t         d_history;
+
+    std::vector<change> d_scratch;
+
+    void changed(const apx::entity entity, const mask_type mask)
+    {
+        d_open.push_back({entity, mask});
+    }
+
+    // Sorts the changes by entity and merges those to the same entity.
+    static void merge(std::vector<change>& changes)
+    {
+        if (!std::ranges::is_sorted(changes, {}, &change::entity)) {
+            std::ranges::sort(changes, {}, &change::entity);
+        }
+        std::size_t out = 0;
+        for (std::size_t i = 0; i != changes.size(); ++i) {
+            if (out != 0 && changes[out - 1].entity == changes[i].entity) {
+                changes[out - 1].mask |= changes[i].mask;
+            } else {
+                changes[out++] = changes[i];
+            }
+        }
+        changes.resize(out);
+    }
+
+    void forget_frames_before(const std::uint64_t seq)
+    {
+        while (!d_frames.empty() && d_frames.front().seq <= seq) {
+            d_base = d_frames.front().seq;
+            d_frames.pop_front();
+        }
+    }
+
+    [[nodiscard]] mask_type present(const apx::entity entity) const
+    {
+        mask_type mask = 0;
+        mask_type bit = 1;
+        ((mask |= d_registry->template has<Ts>(entity) ? bit : 0, bit <<= 1), ...);
+        return mask;
+    }
+
+    void write_update(apx::byte_writer& out, const apx::entity entity, const mask_type mask) const
+    {
+        const mask_type has = present(entity);
+        out.varint(static_cast<std::uint8_t>(op::update));
+        out.varint(static_cast<std::uint64_t>(entity));
+        out.varint(mask & has);
+        out.varint(mask & ~has);
+        mask_type bit = 1;
+        ((mask & has & bit ? out.raw(d_registry->template get<Ts>(entity)) : void(), bit <<= 1), ...);
+    }
+
+public:
+    // Replicates changes made to the registry from now on. Consumers that have not yet
+    // acknowledged a packet, or have fallen more than the given number of frames
+    // behind, are sent every entity of interest in full.
+    explicit replicator(Registry& registry, const std::size_t history = 64)
+        : d_registry{&registry}
+        , d_history{history}
+    {
+        d_registry->observe(*this);
+    }
+
+    replicator(const replicator&) = delete;
+    replicator& operator=(const replicator&) = delete;
+
+    ~replicator() override
+    {
+        d_registry->unobserve(*this);
+    }
+
+    // Adds a consumer that is sent the entities the interest function accepts, or all
+    // of them if there is none.
+    consumer_id add_consumer(interest_type interest = {})
+    {
+        auto c = std::make_unique<consumer>();
+        c->interest = std::move(interest);
+        d_consumers.push_back(std::move(c));
+        return d_consumers.size() - 1;
+    }
+
+    void remove_consumer(const consumer_id id)
+    {
+        d_consumers[id].reset();
+    }
+
+    // Re-evaluates the interest of the consumer in every entity, rather than only in
+    // those that change, until a packet doing so is acknowledged.
+    void rescan(const consumer_id id)
+    {
+        d_consumers[id]->rescan = true;
+    }
+
+    // Marks components of the entity as changed in ways the registry did not see.
+    template <typename... Us>
+    void touch(const apx::entity entity)
+    {
+        changed(entity, (bit_of[Registry::template id_of<Us>()] | ...));
+    }
+
+    // Closes the frame of changes made since the last call. Packets cover the changes
+    // of closed frames.
+    void end_frame()
+    {
+        merge(d_open);
+        d_frames.push_back({++d_seq, std::move(d_open)});
+        d_open.clear();
+        if (d_frames.size() > d_history) {
+            forget_frames_before(d_frames.front().seq);
+        }
+    }
+
+    // Replaces the contents of out with a packet bringing the consumer up to date, as
+    // of the last closed frame, from the last packet it acknowledged.
+    void encode(const consumer_id id, std::vector<std::byte>& out)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        consumer& c = *d_consumers[id];
+        const bool full = !c.acked || *c.acked < d_base;
+        const bool rescan = full || c.rescan;
+
+        // The entities that changed since the acknowledged packet, and every entity
+        // whose presence a packet since then changed, since it may have been lost.
+        d_scratch.clear();
+        if (!full) {
+            for (const frame& f : d_frames) {
+                if (f.seq > *c.acked) {
+                    d_scratch.insert(d_scratch.end(), f.changes.begin(), f.changes.end());
+                }
+            }
+        }
+        std::unordered_map<apx::entity, bool> uncertain;
+        for (const in_flight& p : c.packets) {
+            for (const apx::entity e : p.entered) {
+                uncertain[e] = uncertain[e];
+                d_scratch.push_back({e, 0});
+            }
+            for (const apx::entity e : p.left) {
+                uncertain[e] = true;
+                d_scratch.push_back({e, 0});
+            }
+        }
+        if (rescan) {
+            for (const apx::entity e : d_registry->all()) {
+                d_scratch.push_back({e, full ? all : 0});
+            }
+            for (const apx::entity e : c.known) {
+                d_scratch.push_back({e, 0});
+            }
+        }
+        merge(d_scratch);
+
+        out.clear();
+        apx::byte_writer writer{out};
+        writer.varint(d_seq);
+        in_flight packet{d_seq, rescan, {}, {}};
+        std::size_t records = 0;
+
+        for (const auto [e, mask] : d_scratch) {
+            const bool valid = d_registry->valid(e);
+            const bool wanted = valid && (!c.interest || c.interest(*d_registry, e));
+            const auto maybe = uncertain.find(e);
+            const bool known = c.known.contains(e);
+            if (wanted) {
+                if (!known || (maybe != uncertain.end() && maybe->second)) {
+                    write_update(writer, e, all);
+                    packet.entered.push_back(e);
+                    ++records;
+                } else if (mask != 0) {
+                    write_update(writer, e, mask);
+                    ++records;
+                }
+            } else if (known || maybe != uncertain.end()) {
+                writer.varint(static_cast<std::uint8_t>(valid ? op::forget : op::destroy));
+                writer.varint(static_cast<std::uint64_t>(e));
+                packet.left.push_back(e);
+                ++records;
+            }
+        }
+        c.packets.push_back(std::move(packet));
+
+        c.stats.packets += 1;
+        c.stats.bytes += out.size();
+        c.stats.last_bytes = out.size();
+        c.stats.records += records;
+        c.stats.encode_time += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    }
+
+    // Records that the consumer has applied the packet with the given sequence number,
+    // so that later packets are made relative to it. Acknowledgements of packets older
+    // than the last acknowledged one are ignored.
+    void acknowledge(const consumer_id id, const std::uint64_t seq)
+    {
+        consumer& c = *d_consumers[id];
+        if (c.acked && seq <= *c.acked) {
+            return;
+        }
+        while (!c.packets.empty() && c.packets.front().seq < seq) {
+            c.packets.pop_front();
+        }
+        if (c.packets.empty() || c.packets.front().seq != seq) {
+            return;
+        }
+
+        // Later packets are relative to this one or an earlier one, so they cover
+        // everything that this one changes about the earlier ones.
+        const in_flight& p = c.packets.front();
+        for (const apx::entity e : p.left) {
+            c.known.erase(e);
+        }
+        c.known.insert(p.entered.begin(), p.entered.end());
+        c.rescan = c.rescan && !p.rescan;
+        c.acked = seq;
+        c.packets.pop_front();
+
+        // Forget the frames that every consumer has acknowledged.
+        std::uint64_t oldest = seq;
+        for (const auto& other : d_consumers) {
+            if (other && other->acked) {
+                oldest = std::min(oldest, *other->acked);
+            }
+        }
+        forget_frames_before(oldest);
+    }
+
+    [[nodiscard]] const apx::replication_stats& stats(const consumer_id id) const
+    {
+        return d_consumers[id]->stats;
+    }
+
+    // The sequence number of the last closed frame.
+    [[nodiscard]] std::uint64_t seq() const noexcept
+    {
+        return d_seq;
+    }
+
+    void on_create(const apx::entity entity) override
+    {
+        changed(entity, 0);
+    }
+
+    void on_destroy(const apx::entity entity) override
+    {
+        changed(entity, 0);
+    }
+
+    void on_add(const apx::entity entity, const apx::component_id id, const void*) override
+    {
+        if (bit_of[id] != 0) {
+            changed(entity, bit_of[id]);
+        }
+    }
+
+    void on_remove(const apx::entity entity, const apx::component_id id, const void*) override
+    {
+        if (bit_of[id] != 0) {
+            changed(entity, bit_of[id]);
+        }
+    }
+
+    void on_write(const apx::entity entity, const apx::component_id id, const void*) override
+    {
+        if (bit_of[id] != 0) {
+            changed(entity, bit_of[id]);
+        }
+    }
+
+    // Every consumer then starts again from nothing.
+    void on_clear() override
+    {
+        d_frames.clear();
+        d_open.clear();
+        d_base = d_seq + 1;
+    }
+};
+
+// Applies the packets of a replicator to a registry, creating an entity there for
+// each one sent, which lets a replicator be tested against consumers in the same
+// process. The components are given in the same order as to the replicator.
+template <typename Registry, typename... Ts>
+class replica
+{
+    using mask_type = std::uint64_t;
+    using op = apx::detail::replication_op;
+
+    Registry*                                    d_registry;
+    std::unordered_map<apx::entity, apx::entity> d_local;
+    std::uint64_t                                d_seq = 0;
+
+    template <typename T>
+    void apply_component(apx::byte_reader& in, const apx::entity local, const mask_type bit, const mask_type sent, const mask_type removed)
+    {
+        if (sent & bit) {
+            const T value = in.raw<T>();
+            if (d_registry->template has<T>(local)) {
+                d_registry->template patch<T>(local, [&](T& component) { component = value; });
+            } else {
+                d_registry->template add<T>(local, value);
+            }
+        } else if (removed & bit) {
+            d_registry->template remove<T>(local);
+        }
+    }
+
+public:
+    explicit replica(Registry& registry) : d_registry{&registry} {}
+
+    // Applies a packet, returning its sequence number to acknowledge, or nullopt if it
+    // is malformed, in which case some of it may have been applied. Packets older than
+    // the last one applied are ignored.
+    std::optional<std::uint64_t> apply(const std::span<const std::byte> packet)
+    {
+        apx::byte_reader in{packet};
+        const std::uint64_t seq = in.varint();
+        if (!in.ok()) {
+            return std::nullopt;
+        }
+        if (seq < d_seq) {
+            return d_seq;
+        }
+
+        while (in.ok() && !in.done()) {
+            const auto what = static_cast<op>(in.varint());
+            const auto remote = static_cast<apx::entity>(in.varint());
+            if (what == op::update) {
+                const mask_type sent = in.varint();
+                const mask_type removed = in.varint();
+                auto [it, inserted] = d_local.try_emplace(remote, apx::null);
+                if (inserted) {
+                    it->second = d_registry->create();
+                }
+                mask_type bit = 1;
+                ((apply_component<Ts>(in, it->second, bit, sent, removed), bit <<= 1), ...);
+            } else if (const auto it = d_local.find(remote); it != d_local.end()) {
+                d_registry->destroy(it->second);
+                d_local.erase(it);
+            }
+        }
+        if (!in.ok()) {
+            return std::nullopt;
+        }
+        d_seq = seq;
+        return seq;
+    }
+
+    // Returns the local entity standing in for the replicated one, or apx::null.
+    [[nodiscard]] apx::entity local(const apx::entity remote) const
+    {
+        const auto it = d_local.find(remote);
+        return it != d_local.end() ? it->second : apx::null;
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        return d_local.size();
+    }
+};
+
+}
+
+#endif // APECS_REPLICATION_HPP_
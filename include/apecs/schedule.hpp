@@ -0,0 +1,191 @@
+#ifndef APECS_SCHEDULE_HPP_
+#define APECS_SCHEDULE_HPP_
+
+#include <apecs/apecs.hpp>
+
+#include <array>
+#include <bitset>
+#include <functional>
+#include <memory>
+#include <span>
+#include <tuple>
+#include <vector>
+
+namespace apx {
+
+// Declare that a stage reads or writes the given components of entities other than
+// the one it was called for, or outside of its per-entity body.
+template <typename... Ts> struct reads {};
+template <typename... Ts> struct writes {};
+
+// Runs a sequence of per-entity stages over a registry, each like a loop over a
+// view_get, fusing consecutive stages into a single pass over the entities where that
+// cannot change the result, so that the components are streamed from memory once.
+//
+// A stage's body is given the components of one entity at a time. As long as that is
+// all it touches, running it interleaved with its neighbours, entity by entity, is
+// the same as running it over every entity in turn. Anything else it accesses through
+// other entities must be declared with apx::reads and apx::writes, and stages are not
+// fused when one could then see a different state from the other's.
+//
+// A stage joins the pass of the stage before it if its components include all of the
+// components driving that pass, and it is skipped for the entities of the pass that
+// lack its other components. As with views, the bodies must not add or remove
+// components.
+template <typename Registry>
+class schedule
+{
+    static constexpr std::size_t component_count = std::tuple_size_v<std::remove_const_t<decltype(Registry::tags)>>;
+    using mask_type = std::bitset<component_count>;
+
+    struct stage
+    {
+        // The components given to the body, and those declared as accessed elsewhere.
+        mask_type components;
+        mask_type reads;
+        mask_type writes;
+
+        // The body, shared by both ways of running the stage in case it has state.
+        std::shared_ptr<void> body;
+
+        // Runs the body for one entity of a pass driven by another stage, given the
+        // components that the driving stage has already found for it by id, and null
+        // for the rest. The entity may not have all of the stage's components.
+        void (*visit)(void* body, Registry&, apx::entity, void* const* resolved) = nullptr;
+
+        // Runs a pass driven by this stage's view, which also visits each entity with
+        // the given stages after this one.
+        std::function<void(Registry&, std::span<const stage* const>)> drive;
+    };
+
+    std::vector<stage>       d_stages;
+    std::vector<std::size_t> d_passes;
+
+    template <typename... Ts>
+    static mask_type mask_of()
+    {
+        mask_type mask;
+        (mask.set(Registry::template id_of<Ts>()), ...);
+        return mask;
+    }
+
+    template <typename... Ts> static void declare(stage& s, apx::reads<Ts...>) { s.reads |= mask_of<Ts...>(); }
+    template <typename... Ts> static void declare(stage& s, apx::writes<Ts...>) { s.writes |= mask_of<Ts...>(); }
+
+    // True if running the stages interleaved entity by entity cannot change what either
+    // of them sees. Each stage's own components are treated as both read and written.
+    static bool independent(const stage& a, const stage& b)
+    {
+        const auto conflicts = [](const stage& x, const stage& y) {
+            return (x.writes & (y.components | y.reads | y.writes)).any()
+                || (x.reads & (y.components | y.writes)).any();
+        };
+        return !conflicts(a, b) && !conflicts(b, a);
+    }
+
+    // Splits the stages into passes: each pass starts where a stage cannot be fused
+    // with the pass before it.
+    void plan()
+    {
+        d_passes.clear();
+        for (std::size_t i = 0; i != d_stages.size(); ++i) {
+            const stage& s = d_stages[i];
+            bool fuse = !d_passes.empty();
+            if (fuse) {
+                const std::size_t first = d_passes.back();
+                fuse = (s.components & d_stages[first].components) == d_stages[first].components;
+                for (std::size_t j = first; fuse && j != i; ++j) {
+                    fuse = independent(d_stages[j], s);
+                }
+            }
+            if (!fuse) {
+                d_passes.push_back(i);
+            }
+        }
+    }
+
+public:
+    // Adds a stage that calls body with references to the given components of every
+    // entity that has them all, after the stages before it. Any apx::reads and
+    // apx::writes after the body declare what else it accesses.
+    template <typename... Ts, typename Body, typename... Access>
+    void add(Body body, Access... access)
+    {
+        static_assert(sizeof...(Ts) > 0);
+        stage s;
+        s.components = mask_of<Ts...>();
+        (declare(s, access), ...);
+
+        auto shared = std::make_shared<Body>(std::move(body));
+        s.body = shared;
+        s.visit = [](void* body, Registry& reg, const apx::entity entity, void* const* resolved) {
+            const std::tuple<Ts*...> components{resolved[Registry::template id_of<Ts>()]
+                ? static_cast<Ts*>(resolved[Registry::template id_of<Ts>()])
+                : reg.template get_if<Ts>(entity)...};
+            if ((std::get<Ts*>(components) && ...)) {
+                (*static_cast<Body*>(body))(*std::get<Ts*>(components)...);
+            }
+        };
+
+        // The driving stage walks its view once, and hands the components it finds for
+        // each entity on to the fused stages, which only look up those it lacks.
+        s.drive = [shared](Registry& reg, const std::span<const stage* const> fused) {
+            std::array<void*, component_count> resolved{};
+            const auto run = [&](const apx::entity entity, Ts&... components) {
+                (*shared)(components...);
+                if (!fused.empty()) {
+                    ((resolved[Registry::template id_of<Ts>()] = &components), ...);
+                    for (const stage* f : fused) {
+                        f->visit(f->body.get(), reg, entity, resolved.data());
+                    }
+                }
+            };
+
+            if constexpr (sizeof...(Ts) == 1) {
+                const auto entities = reg.template view<Ts...>();
+                auto components = reg.template view_get<Ts...>();
+                for (std::size_t i = 0; i != entities.size(); ++i) {
+                    std::apply([&](Ts&... c) { run(entities[i], c...); }, components[i]);
+                }
+            } else {
+                const auto components = reg.template view_get<Ts...>();
+                for (auto it = components.begin(); it != components.end(); ++it) {
+                    std::apply([&](Ts&... c) { run(it.entity(), c...); }, *it);
+                }
+            }
+        };
+
+        d_stages.push_back(std::move(s));
+        plan();
+    }
+
+    // Runs every stage, one pass over the entities at a time.
+    void run(Registry& reg) const
+    {
+        std::vector<const stage*> fused;
+        for (std::size_t p = 0; p != d_passes.size(); ++p) {
+            const std::size_t first = d_passes[p];
+            const std::size_t last = p + 1 != d_passes.size() ? d_passes[p + 1] : d_stages.size();
+            fused.clear();
+            for (std::size_t i = first + 1; i != last; ++i) {
+                fused.push_back(&d_stages[i]);
+            }
+            d_stages[first].drive(reg, fused);
+        }
+    }
+
+    // The number of passes over the entities that run() makes.
+    [[nodiscard]] std::size_t passes() const noexcept
+    {
+        return d_passes.size();
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        return d_stages.size();
+    }
+};
+
+}
+
+#endif // APECS_SCHEDULE_HPP_
@@ -0,0 +1,118 @@
+#ifndef APECS_SERIALIZE_HPP_
+#define APECS_SERIALIZE_HPP_
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace apx {
+
+// Appends values to a byte buffer in a compact form: integers as LEB128 varints, and
+// trivially copyable values as their bytes. Byte order is that of the machine.
+class byte_writer
+{
+    std::vector<std::byte>* d_out;
+
+public:
+    explicit byte_writer(std::vector<std::byte>& out) : d_out{&out} {}
+
+    void varint(std::uint64_t value)
+    {
+        while (value >= 0x80) {
+            d_out->push_back(static_cast<std::byte>(value | 0x80));
+            value >>= 7;
+        }
+        d_out->push_back(static_cast<std::byte>(value));
+    }
+
+    void bytes(const void* data, const std::size_t size)
+    {
+        const auto* first = static_cast<const std::byte*>(data);
+        d_out->insert(d_out->end(), first, first + size);
+    }
+
+    template <typename T>
+    void raw(const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        bytes(&value, sizeof(T));
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        return d_out->size();
+    }
+};
+
+// Reads back what a byte_writer wrote. Reading past the end, or a varint that does not
+// fit, yields zeroes and marks the reader as failed rather than reading out of bounds,
+// so that input from elsewhere can be checked once at the end with ok().
+class byte_reader
+{
+    std::span<const std::byte> d_in;
+    std::size_t                d_pos = 0;
+    bool                       d_ok = true;
+
+public:
+    explicit byte_reader(const std::span<const std::byte> in) : d_in{in} {}
+
+    std::uint64_t varint()
+    {
+        std::uint64_t value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            if (d_pos == d_in.size()) {
+                break;
+            }
+            const auto byte = static_cast<std::uint8_t>(d_in[d_pos++]);
+            value |= std::uint64_t{byte & 0x7fu} << shift;
+            if ((byte & 0x80) == 0) {
+                return value;
+            }
+        }
+        d_ok = false;
+        return 0;
+    }
+
+    // Returns the next size bytes, or nullptr if there are not that many left.
+    const std::byte* bytes(const std::size_t size)
+    {
+        if (d_in.size() - d_pos < size) {
+            d_ok = false;
+            d_pos = d_in.size();
+            return nullptr;
+        }
+        const std::byte* data = d_in.data() + d_pos;
+        d_pos += size;
+        return data;
+    }
+
+    template <typename T>
+    T raw()
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        std::array<std::byte, sizeof(T)> value{};
+        if (const std::byte* data = bytes(sizeof(T))) {
+            std::memcpy(value.data(), data, sizeof(T));
+        }
+        return std::bit_cast<T>(value);
+    }
+
+    [[nodiscard]] bool done() const noexcept
+    {
+        return d_pos == d_in.size();
+    }
+
+    [[nodiscard]] bool ok() const noexcept
+    {
+        return d_ok;
+    }
+};
+
+}
+
+#endif // APECS_SERIALIZE_HPP_
@@ -0,0 +1,348 @@
+#ifndef APECS_SHARED_HPP_
+#define APECS_SHARED_HPP_
+
+#include <apecs/apecs.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace apx {
+
+namespace detail {
+
+inline constexpr std::uint32_t shared_magic = 0x53585041; // "APXS"
+inline constexpr std::uint32_t shared_version = 1;
+inline constexpr std::size_t   shared_alignment = 64;
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "the sequence number must be usable across processes");
+
+// The layout of a shared region: this header, then one shared_column per component,
+// then the arrays they point at. Positions are offsets from the start of the region,
+// since each process maps it at a different address.
+struct shared_header
+{
+    std::uint32_t              magic;
+    std::uint32_t              version;
+    std::uint32_t              columns;
+    std::uint32_t              reserved;
+
+    // Odd while the writer is copying the registry in, and advanced by two for every
+    // copy, so that a reader can tell whether what it read was changed underneath it.
+    std::atomic<std::uint64_t> seq;
+
+    std::uint64_t              entity_count;
+    std::uint64_t              entities;
+};
+
+struct shared_column
+{
+    std::uint64_t count;
+    std::uint64_t keys;
+    std::uint64_t values;
+    std::uint64_t stride;
+};
+
+constexpr std::size_t shared_align(const std::size_t offset) noexcept
+{
+    return (offset + shared_alignment - 1) & ~(shared_alignment - 1);
+}
+
+// A shared memory object mapped into this process, which unmaps it when destroyed.
+class shared_mapping
+{
+    void*       d_data = nullptr;
+    std::size_t d_size = 0;
+
+public:
+    shared_mapping() = default;
+    shared_mapping(void* data, std::size_t size) : d_data{data}, d_size{size} {}
+
+    shared_mapping(shared_mapping&& other) noexcept
+        : d_data{std::exchange(other.d_data, nullptr)}
+        , d_size{std::exchange(other.d_size, 0)}
+    {}
+
+    shared_mapping& operator=(shared_mapping&& other) noexcept
+    {
+        std::swap(d_data, other.d_data);
+        std::swap(d_size, other.d_size);
+        return *this;
+    }
+
+    ~shared_mapping()
+    {
+        if (d_data) {
+            ::munmap(d_data, d_size);
+        }
+    }
+
+    [[nodiscard]] std::byte* data() const noexcept { return static_cast<std::byte*>(d_data); }
+    [[nodiscard]] std::size_t size() const noexcept { return d_size; }
+    [[nodiscard]] explicit operator bool() const noexcept { return d_data != nullptr; }
+};
+
+// Maps the named shared memory object, creating it with the given size if writable.
+inline shared_mapping map_shared(const std::string& name, const std::size_t size, const bool writable)
+{
+    const int fd = writable ? ::shm_open(name.c_str(), O_CREAT | O_RDWR, 0644) : ::shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return {};
+    }
+
+    std::size_t length = size;
+    struct stat info{};
+    const bool sized = writable ? ::ftruncate(fd, static_cast<::off_t>(size)) == 0 : ::fstat(fd, &info) == 0;
+    if (!writable) {
+        length = static_cast<std::size_t>(info.st_size);
+    }
+
+    void* data = MAP_FAILED;
+    if (sized && length >= sizeof(shared_header)) {
+        data = ::mmap(nullptr, length, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    return data != MAP_FAILED ? shared_mapping{data, length} : shared_mapping{};
+}
+
+}
+
+// Publishes the entities and components of a registry into a named POSIX shared memory
+// object, for other processes to read with apx::shared_reader without any copying or
+// messages. Each publish copies the registry's columns into the region as it is
+// between ticks; readers that overlap a publish notice and retry, so the writer never
+// waits for them. The region has a fixed size, as readers have it mapped.
+template <typename Registry>
+class shared_publisher
+{
+    std::string            d_name;
+    detail::shared_mapping d_region;
+
+    [[nodiscard]] detail::shared_header& header() const noexcept
+    {
+        return *reinterpret_cast<detail::shared_header*>(d_region.data());
+    }
+
+public:
+    // Creates the shared memory object with the given name, replacing any left behind,
+    // and room for the given number of bytes of columns. Check that it succeeded with
+    // operator bool.
+    shared_publisher(std::string name, const std::size_t capacity)
+        : d_name{std::move(name)}
+    {
+        ::shm_unlink(d_name.c_str());
+        d_region = detail::map_shared(d_name, capacity, true);
+        if (d_region) {
+            auto& h = *new (d_region.data()) detail::shared_header{};
+            h.magic = detail::shared_magic;
+            h.version = detail::shared_version;
+            h.columns = std::tuple_size_v<std::remove_const_t<decltype(Registry::tags)>>;
+        }
+    }
+
+    shared_publisher(const shared_publisher&) = delete;
+    shared_publisher& operator=(const shared_publisher&) = delete;
+
+    // Removes the name; readers that have it mapped keep their mapping.
+    ~shared_publisher()
+    {
+        ::shm_unlink(d_name.c_str());
+    }
+
+    [[nodiscard]] explicit operator bool() const noexcept
+    {
+        return static_cast<bool>(d_region);
+    }
+
+    // Copies the registry into the region, returning false without changing it if it
+    // does not fit. The components must be trivially copyable.
+    bool publish(const Registry& reg)
+    {
+        assert(d_region);
+        std::size_t offset = detail::shared_align(sizeof(detail::shared_header) + header().columns * sizeof(detail::shared_column));
+        const std::size_t entities = offset;
+        offset = detail::shared_align(offset + reg.size() * sizeof(apx::entity));
+        std::array<detail::shared_column, std::tuple_size_v<std::remove_const_t<decltype(Registry::tags)>>> columns{};
+        apx::meta::for_each(Registry::tags, [&] <typename T> (apx::meta::tag<T>) {
+            static_assert(std::is_trivially_copyable_v<T>, "shared components are read as their bytes");
+            const auto& set = reg.template storage<T>();
+            auto& column = columns[Registry::template id_of<T>()];
+            column.count = set.size();
+            column.stride = sizeof(T);
+            column.keys = offset;
+            offset = detail::shared_align(offset + set.keys().size_bytes());
+            column.values = offset;
+            offset = detail::shared_align(offset + set.values().size_bytes());
+        });
+        if (offset > d_region.size()) {
+            return false;
+        }
+
+        auto& h = header();
+        const std::uint64_t seq = h.seq.load(std::memory_order_relaxed);
+        h.seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        std::byte* base = d_region.data();
+        h.entity_count = reg.size();
+        h.entities = entities;
+        auto* out = reinterpret_cast<apx::entity*>(base + entities);
+        for (const apx::entity entity : reg.all()) {
+            *out++ = entity;
+        }
+        std::memcpy(base + sizeof(detail::shared_header), columns.data(), sizeof(columns));
+        apx::meta::for_each(Registry::tags, [&] <typename T> (apx::meta::tag<T>) {
+            const auto& set = reg.template storage<T>();
+            const auto& column = columns[Registry::template id_of<T>()];
+            std::memcpy(base + column.keys, set.keys().data(), set.keys().size_bytes());
+            std::memcpy(base + column.values, set.values().data(), set.values().size_bytes());
+        });
+
+        h.seq.store(seq + 2, std::memory_order_release);
+        return true;
+    }
+
+    // The number of times the registry has been published, times two.
+    [[nodiscard]] std::uint64_t epoch() const noexcept
+    {
+        return header().seq.load(std::memory_order_relaxed);
+    }
+};
+
+// Reads a registry published by apx::shared_publisher, given the same components in
+// the same order, mapping its region read-only.
+template <typename... Comps>
+class shared_reader
+{
+    detail::shared_mapping d_region;
+
+    [[nodiscard]] const detail::shared_header& header() const noexcept
+    {
+        return *reinterpret_cast<const detail::shared_header*>(d_region.data());
+    }
+
+public:
+    // A view of the published registry, pointing straight into the region. Anything
+    // read through it may be torn by a concurrent publish until shared_reader::read
+    // returns true, so it must be copied out, or only acted on afterwards.
+    class snapshot
+    {
+        const std::byte* d_base;
+        std::size_t      d_size;
+
+        [[nodiscard]] const detail::shared_header& header() const noexcept
+        {
+            return *reinterpret_cast<const detail::shared_header*>(d_base);
+        }
+
+        // An array in the region, or an empty one if a torn read gave a position outside
+        // of it.
+        template <typename T>
+        [[nodiscard]] std::span<const T> array(const std::uint64_t offset, const std::uint64_t count) const noexcept
+        {
+            if (offset > d_size || count > (d_size - offset) / sizeof(T)) {
+                return {};
+            }
+            return {reinterpret_cast<const T*>(d_base + offset), count};
+        }
+
+        template <typename T>
+        [[nodiscard]] const detail::shared_column& column() const noexcept
+        {
+            const auto* columns = reinterpret_cast<const detail::shared_column*>(d_base + sizeof(detail::shared_header));
+            return columns[apx::meta::index_of<T, Comps...>()];
+        }
+
+    public:
+        snapshot(const std::byte* base, const std::size_t size) : d_base{base}, d_size{size} {}
+
+        [[nodiscard]] std::span<const apx::entity> entities() const noexcept
+        {
+            return array<apx::entity>(header().entities, header().entity_count);
+        }
+
+        // The entities with the component, and their components at the same positions.
+        template <typename T>
+        [[nodiscard]] std::span<const apx::entity> keys() const noexcept
+        {
+            return array<apx::entity>(column<T>().keys, column<T>().count);
+        }
+
+        template <typename T>
+        [[nodiscard]] std::span<const T> values() const noexcept
+        {
+            return array<T>(column<T>().values, column<T>().count);
+        }
+    };
+
+    // Attaches to the named region. Check that it succeeded, and that the region holds
+    // the same components, with operator bool.
+    explicit shared_reader(const std::string& name)
+        : d_region{detail::map_shared(name, 0, false)}
+    {
+        if (d_region) {
+            const auto& h = header();
+            bool ok = h.magic == detail::shared_magic && h.version == detail::shared_version && h.columns == sizeof...(Comps)
+                && d_region.size() >= sizeof(detail::shared_header) + sizeof...(Comps) * sizeof(detail::shared_column);
+            if (ok) {
+                const auto* columns = reinterpret_cast<const detail::shared_column*>(d_region.data() + sizeof(detail::shared_header));
+                std::size_t i = 0;
+                ((ok = ok && (columns[i].stride == 0 || columns[i].stride == sizeof(Comps)), ++i), ...);
+            }
+            if (!ok) {
+                d_region = {};
+            }
+        }
+    }
+
+    [[nodiscard]] explicit operator bool() const noexcept
+    {
+        return static_cast<bool>(d_region);
+    }
+
+    // Calls f with a snapshot of the published registry until it runs without a publish
+    // overlapping it, and returns true, or false if that failed the given number of
+    // times, or nothing has been published yet.
+    template <typename F>
+    bool read(F&& f, int attempts = 64) const
+    {
+        const auto& h = header();
+        for (; attempts > 0; --attempts) {
+            const std::uint64_t before = h.seq.load(std::memory_order_acquire);
+            if (before == 0) {
+                return false;
+            }
+            if (before % 2 != 0) {
+                continue;
+            }
+            f(snapshot{d_region.data(), d_region.size()});
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (h.seq.load(std::memory_order_relaxed) == before) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // The publisher's epoch, see shared_publisher::epoch.
+    [[nodiscard]] std::uint64_t epoch() const noexcept
+    {
+        return header().seq.load(std::memory_order_acquire);
+    }
+};
+
+}
+
+#endif // APECS_SHARED_HPP_
@@ -0,0 +1,303 @@
+#ifndef APECS_STREAMING_HPP_
+#define APECS_STREAMING_HPP_
+
+#include <apecs/apecs.hpp>
+#include <apecs/serialize.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace apx {
+
+namespace detail {
+
+inline constexpr std::uint32_t chunk_magic = 0x4b585041; // "APXK"
+inline constexpr std::uint32_t chunk_version = 1;
+
+}
+
+// Writes the given entities of a registry and their components to the end of out, as a
+// chunk for apx::streaming_loader to load into another registry. The entities are
+// numbered by their position in the span, which is also the order they are created in
+// when loaded. A chunk holds components as their bytes, in the byte order of the
+// machine.
+template <typename... Comps>
+void save_chunk(const apx::registry<Comps...>& reg, const std::span<const apx::entity> entities, std::vector<std::byte>& out)
+{
+    static_assert((std::is_trivially_copyable_v<Comps> && ...), "chunks hold components as their bytes");
+    assert(reg.valid(entities));
+
+    apx::byte_writer writer{out};
+    writer.raw(detail::chunk_magic);
+    writer.raw(detail::chunk_version);
+    writer.varint(sizeof...(Comps));
+    (writer.varint(sizeof(Comps)), ...);
+    writer.varint(entities.size());
+
+    // Each component is the positions of the entities that have it, as gaps from the one
+    // before, followed by the components.
+    std::vector<std::size_t> rows;
+    apx::meta::for_each(apx::registry<Comps...>::tags, [&] <typename T> (apx::meta::tag<T>) {
+        rows.clear();
+        for (std::size_t i = 0; i != entities.size(); ++i) {
+            if (reg.template has<T>(entities[i])) {
+                rows.push_back(i);
+            }
+        }
+        writer.varint(rows.size());
+        std::size_t previous = 0;
+        for (const std::size_t row : rows) {
+            writer.varint(row - previous);
+            previous = row;
+        }
+        for (const std::size_t row : rows) {
+            writer.raw(reg.template get<T>(entities[row]));
+        }
+    });
+}
+
+template <typename Registry>
+class streaming_loader;
+
+// Loads chunks written by apx::save_chunk into a registry without stalling the thread
+// that owns it.
+//
+// Chunks are decoded on a background thread into a column per component, ready to be
+// copied into the registry's storage as they are. The owning thread then calls
+// integrate once per frame with a budget of entities, and the loader splices in up to
+// that many: it creates them in one step and appends each column's components for them
+// in bulk, so a frame's cost is bounded by the budget however large a chunk is. A chunk
+// larger than the budget is spread over several frames, a complete entity at a time.
+// Chunks are integrated in the order they were loaded.
+template <typename... Comps>
+class streaming_loader<apx::registry<Comps...>>
+{
+public:
+    using registry_type = apx::registry<Comps...>;
+
+    // Called once a chunk is fully integrated with its entities, in the order that they
+    // were given to save_chunk, for fixing up references between them.
+    using callback_t = std::function<void(std::span<const apx::entity>)>;
+
+private:
+    static_assert((std::is_trivially_copyable_v<Comps> && ...), "chunks hold components as their bytes");
+
+    template <typename T>
+    struct column
+    {
+        // The positions in the chunk of the entities with the component, ascending.
+        std::vector<std::size_t> rows;
+        std::vector<T>           values;
+
+        // How many of them have been integrated.
+        std::size_t              next = 0;
+    };
+
+    struct chunk
+    {
+        std::vector<std::byte>        data;
+        callback_t                    on_loaded;
+        bool                          ok = false;
+        std::size_t                   count = 0;
+        std::tuple<column<Comps>...>  columns;
+        std::vector<apx::entity>      entities;
+    };
+
+    // Chunks waiting to be decoded and decoded chunks waiting to be integrated, oldest
+    // first, and the number of chunks the thread is decoding.
+    mutable std::mutex          d_mutex;
+    std::condition_variable     d_wake;
+    std::condition_variable     d_idle;
+    std::deque<chunk>           d_queued;
+    std::deque<chunk>           d_decoded;
+    std::size_t                 d_busy = 0;
+    bool                        d_stop = false;
+
+    // Only used by the owning thread: the chunk being integrated, and the entities that
+    // a column is being added to.
+    std::optional<chunk>        d_current;
+    std::vector<apx::entity>    d_keys;
+    std::size_t                 d_failed = 0;
+
+    std::thread                 d_thread;
+
+    // Decodes the chunk's data into its columns, returning false if it is malformed or
+    // was written for other components.
+    static bool decode(chunk& c)
+    {
+        apx::byte_reader in{c.data};
+        bool ok = in.raw<std::uint32_t>() == detail::chunk_magic
+            && in.raw<std::uint32_t>() == detail::chunk_version
+            && in.varint() == sizeof...(Comps);
+        ((ok = ok && in.varint() == sizeof(Comps)), ...);
+        c.count = in.varint();
+        ok = ok && in.ok() && c.count <= c.data.size();
+
+        apx::meta::for_each(registry_type::tags, [&] <typename T> (apx::meta::tag<T>) {
+            auto& col = std::get<column<T>>(c.columns);
+            const std::uint64_t size = ok ? in.varint() : 0;
+            ok = ok && size <= c.count;
+            col.rows.resize(ok ? size : 0);
+            std::size_t row = 0;
+            for (std::size_t i = 0; ok && i != col.rows.size(); ++i) {
+                const std::uint64_t gap = in.varint();
+                ok = (i == 0 || gap != 0) && gap < c.count - row;
+                row += gap;
+                col.rows[i] = row;
+            }
+            col.values.resize(ok ? size : 0);
+            for (T& value : col.values) {
+                value = in.raw<T>();
+            }
+        });
+        return ok && in.ok() && in.done();
+    }
+
+    void run()
+    {
+        std::unique_lock lock{d_mutex};
+        while (true) {
+            d_wake.wait(lock, [&] { return d_stop || !d_queued.empty(); });
+            if (d_queued.empty()) {
+                return;
+            }
+            chunk c = std::move(d_queued.front());
+            d_queued.pop_front();
+            ++d_busy;
+            lock.unlock();
+
+            c.ok = decode(c);
+            c.data = {};
+
+            lock.lock();
+            d_decoded.push_back(std::move(c));
+            --d_busy;
+            d_idle.notify_all();
+        }
+    }
+
+    // Creates the next entities of the current chunk, up to the given number, and adds
+    // their components. Returns the number created.
+    std::size_t splice(registry_type& reg, const std::size_t budget)
+    {
+        chunk& c = *d_current;
+        const std::size_t first = c.entities.size();
+        const std::size_t last = first + std::min(budget, c.count - first);
+        c.entities.resize(last);
+        reg.create(std::span{c.entities}.subspan(first));
+
+        apx::meta::for_each(registry_type::tags, [&] <typename T> (apx::meta::tag<T>) {
+            auto& col = std::get<column<T>>(c.columns);
+            const auto begin = col.rows.begin() + static_cast<std::ptrdiff_t>(col.next);
+            const auto end = std::lower_bound(begin, col.rows.end(), last);
+            d_keys.clear();
+            for (auto it = begin; it != end; ++it) {
+                d_keys.push_back(c.entities[*it]);
+            }
+            reg.template add<T>(d_keys, std::span<const T>{col.values}.subspan(col.next, d_keys.size()));
+            col.next += d_keys.size();
+        });
+        return last - first;
+    }
+
+public:
+    streaming_loader()
+        : d_thread{[this] { run(); }}
+    {}
+
+    streaming_loader(const streaming_loader&) = delete;
+    streaming_loader& operator=(const streaming_loader&) = delete;
+
+    // Stops once the chunks already loaded are decoded. Chunks not yet integrated are
+    // discarded.
+    ~streaming_loader()
+    {
+        {
+            std::lock_guard lock{d_mutex};
+            d_stop = true;
+        }
+        d_wake.notify_one();
+        d_thread.join();
+    }
+
+    // Queues a chunk written by save_chunk to be decoded on the background thread, and
+    // integrated by a later call to integrate.
+    void load(std::vector<std::byte> data, callback_t on_loaded = {})
+    {
+        chunk c;
+        c.data = std::move(data);
+        c.on_loaded = std::move(on_loaded);
+        {
+            std::lock_guard lock{d_mutex};
+            d_queued.push_back(std::move(c));
+        }
+        d_wake.notify_one();
+    }
+
+    // Adds the entities of decoded chunks to the registry, up to the given number, and
+    // returns how many were added. Never waits for the background thread: a chunk that
+    // is not decoded yet, and every chunk after it, waits for a later call.
+    std::size_t integrate(registry_type& reg, const std::size_t budget)
+    {
+        std::size_t integrated = 0;
+        while (integrated < budget) {
+            if (!d_current) {
+                std::lock_guard lock{d_mutex};
+                if (d_decoded.empty()) {
+                    break;
+                }
+                d_current.emplace(std::move(d_decoded.front()));
+                d_decoded.pop_front();
+            }
+            if (!d_current->ok) {
+                ++d_failed;
+                d_current.reset();
+                continue;
+            }
+
+            integrated += splice(reg, budget - integrated);
+            if (d_current->entities.size() == d_current->count) {
+                if (d_current->on_loaded) {
+                    d_current->on_loaded(d_current->entities);
+                }
+                d_current.reset();
+            }
+        }
+        return integrated;
+    }
+
+    // Waits for the background thread to decode every chunk loaded so far.
+    void flush()
+    {
+        std::unique_lock lock{d_mutex};
+        d_idle.wait(lock, [&] { return d_queued.empty() && d_busy == 0; });
+    }
+
+    // The number of chunks loaded that have not been fully integrated yet.
+    [[nodiscard]] std::size_t pending() const
+    {
+        std::lock_guard lock{d_mutex};
+        return d_queued.size() + d_busy + d_decoded.size() + (d_current ? 1 : 0);
+    }
+
+    // The number of chunks discarded because they could not be decoded.
+    [[nodiscard]] std::size_t failed() const noexcept
+    {
+        return d_failed;
+    }
+};
+
+}
+
+#endif // APECS_STREAMING_HPP_
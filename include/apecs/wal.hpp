@@ -0,0 +1,587 @@
+#ifndef APECS_WAL_HPP_
+#define APECS_WAL_HPP_
+
+#include <apecs/apecs.hpp>
+#include <apecs/checkpoint.hpp>
+#include <apecs/serialize.hpp>
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace apx {
+
+namespace detail {
+
+inline constexpr std::uint32_t wal_magic = 0x57585041; // "APXW"
+inline constexpr std::uint32_t wal_version = 1;
+
+// A log starts with its magic, version and the label of the checkpoint that it follows
+// on from, then holds groups of records, each of which is the size and hash of its
+// records followed by the records.
+inline constexpr std::size_t wal_header_size = 2 * sizeof(std::uint32_t) + sizeof(std::uint64_t);
+inline constexpr std::size_t wal_group_header_size = 2 * sizeof(std::uint64_t);
+
+enum class wal_op : std::uint8_t { create, destroy, add, remove, write, clear };
+
+// Hashes the records of a group, so that one torn by a crash is recognised.
+inline std::uint64_t wal_hash(const std::span<const std::byte> records) noexcept
+{
+    std::uint64_t hash = apx::detail::mix(records.size());
+    std::size_t i = 0;
+    for (; i + sizeof(std::uint64_t) <= records.size(); i += sizeof(std::uint64_t)) {
+        std::uint64_t word;
+        std::memcpy(&word, records.data() + i, sizeof(word));
+        hash = apx::detail::mix(hash ^ word);
+    }
+    std::uint64_t tail = 0;
+    std::memcpy(&tail, records.data() + i, records.size() - i);
+    return apx::detail::mix(hash ^ tail);
+}
+
+inline bool write_all(const int fd, const std::byte* data, std::size_t size)
+{
+    while (size != 0) {
+        const ::ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+    return true;
+}
+
+// Creates a log at the given path, replacing any there, that follows on from the
+// checkpoint with the given label, and returns its descriptor once the header is on
+// disk, or -1.
+inline int create_log(const std::string& path, const std::uint64_t base)
+{
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    std::vector<std::byte> header;
+    apx::byte_writer out{header};
+    out.raw(wal_magic);
+    out.raw(wal_version);
+    out.raw(base);
+    if (!write_all(fd, header.data(), header.size()) || ::fsync(fd) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Makes a rename or removal in the directory of the given file durable.
+inline void sync_directory(const std::string& path)
+{
+    const std::filesystem::path parent = std::filesystem::path{path}.parent_path();
+    const int fd = ::open(parent.empty() ? "." : parent.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+inline std::optional<std::vector<char>> read_file(const std::string& path)
+{
+    std::ifstream file{path, std::ios::binary};
+    if (!file) {
+        return std::nullopt;
+    }
+    return std::vector<char>{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+}
+
+// The label of the checkpoint that the log at the given path follows on from, or
+// nullopt if there is no log there, or it was cut short while being created.
+inline std::optional<std::uint64_t> log_base(const std::span<const std::byte> contents)
+{
+    apx::byte_reader in{contents};
+    const bool ok = in.raw<std::uint32_t>() == wal_magic && in.raw<std::uint32_t>() == wal_version;
+    const std::uint64_t base = in.raw<std::uint64_t>();
+    return ok && in.ok() ? std::optional{base} : std::nullopt;
+}
+
+// Applies one group of records to the registry, returning false if they do not fit
+// it, which means that the log does not follow on from what is in the registry.
+template <typename... Comps>
+bool replay(const std::span<const std::byte> records, apx::registry<Comps...>& reg)
+{
+    using registry_type = apx::registry<Comps...>;
+
+    apx::byte_reader in{records};
+    while (!in.done()) {
+        const auto op = static_cast<wal_op>(in.raw<std::uint8_t>());
+        if (op == wal_op::clear) {
+            reg.clear();
+            continue;
+        }
+
+        const auto entity = static_cast<apx::entity>(in.varint());
+        if (op == wal_op::create) {
+            if (!in.ok() || reg.create() != entity) {
+                return false;
+            }
+            continue;
+        }
+        if (!in.ok() || !reg.valid(entity)) {
+            return false;
+        }
+        if (op == wal_op::destroy) {
+            reg.destroy(entity);
+            continue;
+        }
+
+        if (op != wal_op::add && op != wal_op::remove && op != wal_op::write) {
+            return false;
+        }
+        const std::uint64_t id = in.varint();
+        bool ok = in.ok() && id < sizeof...(Comps);
+        apx::meta::for_each(registry_type::tags, [&] <typename T> (apx::meta::tag<T>) {
+            if (!ok || id != registry_type::template id_of<T>()) {
+                return;
+            }
+            if (op == wal_op::remove) {
+                ok = reg.template has<T>(entity);
+                if (ok) {
+                    reg.template remove<T>(entity);
+                }
+                return;
+            }
+            const T value = in.raw<T>();
+            ok = in.ok() && reg.template has<T>(entity) == (op == wal_op::write);
+            if (ok && op == wal_op::add) {
+                reg.template add<T>(entity, value);
+            } else if (ok) {
+                reg.template patch<T>(entity, [&](T& component) { component = value; });
+            }
+        });
+        if (!ok) {
+            return false;
+        }
+    }
+    return in.ok();
+}
+
+}
+
+// Logs every change made to a registry, so that a crash loses at most the changes
+// since the last commit rather than everything since the last checkpoint.
+//
+// Creates, destroys, adds and removes are recorded as they happen, as are writes made
+// through patch, into a buffer in memory. Each commit hands the records since the last
+// one to a background thread as a group, which appends it to the log; every group that
+// is waiting when the thread gets to them is written and then synced to disk with a
+// single fsync, so frequent commits share the cost of syncing. The log follows on from
+// a checkpoint, and checkpoint starts a new one, so that apx::recover can load the
+// checkpoint and replay the log on top of it.
+//
+// The checkpoint and the log are replaced as the log is constructed, so recover the
+// registry first. Replay creates entities in the order that the registry would, so a
+// registry using rollback_to should take a checkpoint after rolling back.
+template <typename Registry>
+class write_ahead_log : public apx::observer
+{
+    static constexpr std::size_t component_count = std::tuple_size_v<std::remove_const_t<decltype(Registry::tags)>>;
+
+    Registry*                             d_registry;
+    std::string                           d_checkpoint_path;
+    std::string                           d_log_path;
+    std::array<std::size_t, component_count> d_sizes{};
+
+    // The records since the last commit, after room for the group's header.
+    std::vector<std::byte>                d_records;
+
+    // The label of the last checkpoint, and one being written, after which the log it
+    // followed on from is kept as the old log until it completes.
+    std::uint64_t                         d_generation = 0;
+    std::optional<apx::checkpoint>        d_checkpoint;
+    bool                                  d_has_old = false;
+
+    // Groups waiting for the thread, and emptied buffers for more.
+    mutable std::mutex                    d_mutex;
+    std::condition_variable               d_wake;
+    std::condition_variable               d_synced;
+    std::vector<std::vector<std::byte>>   d_pending;
+    std::vector<std::vector<std::byte>>   d_spare;
+    int                                   d_fd = -1;
+    std::uint64_t                         d_committed = 0;
+    std::uint64_t                         d_durable = 0;
+    std::size_t                           d_syncs = 0;
+    bool                                  d_busy = false;
+    bool                                  d_failed = false;
+    bool                                  d_stop = false;
+
+    std::thread                           d_thread;
+
+    [[nodiscard]] std::string old_log_path() const
+    {
+        return d_log_path + ".old";
+    }
+
+    void record(const detail::wal_op op, const apx::entity entity)
+    {
+        apx::byte_writer out{d_records};
+        out.raw(static_cast<std::uint8_t>(op));
+        out.varint(static_cast<std::uint64_t>(entity));
+    }
+
+    void record(const detail::wal_op op, const apx::entity entity, const apx::component_id id, const void* component)
+    {
+        record(op, entity);
+        apx::byte_writer out{d_records};
+        out.varint(id);
+        if (component) {
+            out.bytes(component, d_sizes[id]);
+        }
+    }
+
+    void run()
+    {
+        std::vector<std::vector<std::byte>> batch;
+        std::unique_lock lock{d_mutex};
+        while (true) {
+            d_wake.wait(lock, [&] { return d_stop || !d_pending.empty(); });
+            if (d_pending.empty()) {
+                return;
+            }
+            std::swap(batch, d_pending);
+            const std::uint64_t last = d_committed;
+            const int fd = d_fd;
+            d_busy = true;
+            lock.unlock();
+
+            bool ok = fd >= 0;
+            for (const auto& group : batch) {
+                ok = ok && detail::write_all(fd, group.data(), group.size());
+            }
+            ok = ok && ::fsync(fd) == 0;
+
+            lock.lock();
+            if (ok) {
+                d_durable = last;
+            }
+            d_failed = d_failed || !ok;
+            ++d_syncs;
+            for (auto& group : batch) {
+                group.clear();
+                d_spare.push_back(std::move(group));
+            }
+            batch.clear();
+            d_busy = false;
+            d_synced.notify_all();
+        }
+    }
+
+    // Starts a new log at the log path that follows on from the given checkpoint.
+    bool start_log(const std::uint64_t base)
+    {
+        const int fd = detail::create_log(d_log_path, base);
+        std::lock_guard lock{d_mutex};
+        if (d_fd >= 0) {
+            ::close(d_fd);
+        }
+        d_fd = fd;
+        d_failed = d_failed || fd < 0;
+        return fd >= 0;
+    }
+
+    // Removes the old log once the checkpoint that made it unnecessary is complete. If
+    // the checkpoint failed, the old log is kept for the next checkpoint to replace.
+    void finish_checkpoint(const checkpoint_status status)
+    {
+        if (status == checkpoint_status::running) {
+            return;
+        }
+        if (status == checkpoint_status::done) {
+            std::remove(old_log_path().c_str());
+            detail::sync_directory(d_log_path);
+            d_has_old = false;
+        }
+        d_checkpoint.reset();
+    }
+
+public:
+    // Takes a checkpoint of the registry at the given path, starts a log of the changes
+    // made to it from now on at the other, and attaches to it. Check that this
+    // succeeded with ok.
+    write_ahead_log(Registry& reg, std::string checkpoint_path, std::string log_path)
+        : d_registry{&reg}
+        , d_checkpoint_path{std::move(checkpoint_path)}
+        , d_log_path{std::move(log_path)}
+        , d_records(detail::wal_group_header_size)
+    {
+        apx::meta::for_each(Registry::tags, [&] <typename T> (apx::meta::tag<T>) {
+            static_assert(std::is_trivially_copyable_v<T>, "logged components are kept as their bytes");
+            d_sizes[Registry::template id_of<T>()] = sizeof(T);
+        });
+
+        // Labels only ever grow, so that a checkpoint is never mistaken for an older one
+        // that a log left behind follows on from.
+        d_generation = apx::checkpoint_label(d_checkpoint_path).value_or(0);
+        for (const std::string& path : {old_log_path(), d_log_path}) {
+            if (const auto contents = detail::read_file(path)) {
+                const auto base = detail::log_base(std::as_bytes(std::span{*contents}));
+                d_generation = std::max(d_generation, base.value_or(0));
+            }
+        }
+        d_has_old = std::filesystem::exists(old_log_path());
+
+        d_thread = std::thread{[this] { run(); }};
+        checkpoint(checkpoint_mode::blocking);
+        reg.observe(*this);
+    }
+
+    write_ahead_log(const write_ahead_log&) = delete;
+    write_ahead_log& operator=(const write_ahead_log&) = delete;
+
+    // Commits the changes made since the last commit and waits for them to be synced.
+    ~write_ahead_log() override
+    {
+        d_registry->unobserve(*this);
+        sync();
+        {
+            std::lock_guard lock{d_mutex};
+            d_stop = true;
+        }
+        d_wake.notify_one();
+        d_thread.join();
+        wait_checkpoint();
+        if (d_fd >= 0) {
+            ::close(d_fd);
+        }
+    }
+
+    void on_create(const apx::entity entity) override
+    {
+        record(detail::wal_op::create, entity);
+    }
+
+    void on_destroy(const apx::entity entity) override
+    {
+        record(detail::wal_op::destroy, entity);
+    }
+
+    void on_add(const apx::entity entity, const apx::component_id id, const void* component) override
+    {
+        record(detail::wal_op::add, entity, id, component);
+    }
+
+    void on_remove(const apx::entity entity, const apx::component_id id, const void*) override
+    {
+        record(detail::wal_op::remove, entity, id, nullptr);
+    }
+
+    void on_write(const apx::entity entity, const apx::component_id id, const void* component) override
+    {
+        record(detail::wal_op::write, entity, id, component);
+    }
+
+    void on_clear() override
+    {
+        d_records.push_back(static_cast<std::byte>(detail::wal_op::clear));
+    }
+
+    // Hands the changes made since the last commit to the background thread to be
+    // written out, without waiting for it, and returns the number of the group that
+    // they make up, to pass to wait. Call this once per tick.
+    std::uint64_t commit()
+    {
+        if (d_checkpoint) {
+            finish_checkpoint(d_checkpoint->poll());
+        }
+        if (d_records.size() == detail::wal_group_header_size) {
+            return d_committed;
+        }
+
+        const auto records = std::span{d_records}.subspan(detail::wal_group_header_size);
+        const std::uint64_t size = records.size();
+        const std::uint64_t hash = detail::wal_hash(records);
+        std::memcpy(d_records.data(), &size, sizeof(size));
+        std::memcpy(d_records.data() + sizeof(size), &hash, sizeof(hash));
+
+        std::unique_lock lock{d_mutex};
+        d_pending.push_back(std::move(d_records));
+        d_records.clear();
+        if (!d_spare.empty()) {
+            d_records = std::move(d_spare.back());
+            d_spare.pop_back();
+        }
+        const std::uint64_t group = ++d_committed;
+        lock.unlock();
+        d_wake.notify_one();
+
+        d_records.resize(detail::wal_group_header_size);
+        return group;
+    }
+
+    // Waits for the given group, and every one before it, to be synced to disk, and
+    // returns true unless writing the log has failed.
+    bool wait(const std::uint64_t group)
+    {
+        std::unique_lock lock{d_mutex};
+        d_synced.wait(lock, [&] { return (d_durable >= group || d_failed) && !d_busy; });
+        return !d_failed;
+    }
+
+    // Commits and waits for the commit.
+    bool sync()
+    {
+        return wait(commit());
+    }
+
+    // Saves the registry to the checkpoint and starts a new log that follows on from it.
+    // By default the checkpoint is forked, as with checkpoint_async, and the old log is
+    // kept until it completes. If an earlier checkpoint failed, that log is still
+    // needed, so this saves the registry before returning instead. Returns false if the
+    // checkpoint failed, in which case the log goes on as before.
+    bool checkpoint(const checkpoint_mode mode = checkpoint_mode::fork)
+    {
+        wait_checkpoint();
+        if (!sync()) {
+            return false;
+        }
+
+        const std::uint64_t generation = d_generation + 1;
+        if (mode == checkpoint_mode::fork && !d_has_old) {
+            if (std::rename(d_log_path.c_str(), old_log_path().c_str()) != 0) {
+                return false;
+            }
+            detail::sync_directory(d_log_path);
+            d_has_old = true;
+            if (!start_log(generation)) {
+                return false;
+            }
+            d_generation = generation;
+            d_checkpoint.emplace(apx::checkpoint_async(*d_registry, d_checkpoint_path, checkpoint_mode::fork, generation));
+            const checkpoint_status status = d_checkpoint->poll();
+            finish_checkpoint(status);
+            return status != checkpoint_status::failed;
+        }
+
+        if (!apx::save_checkpoint(*d_registry, d_checkpoint_path, generation)) {
+            return false;
+        }
+        d_generation = generation;
+        std::remove(old_log_path().c_str());
+        d_has_old = false;
+        return start_log(generation);
+    }
+
+    // Waits for a forked checkpoint to complete, and returns false if it failed, in which
+    // case the next checkpoint is taken before returning.
+    bool wait_checkpoint()
+    {
+        if (d_checkpoint) {
+            finish_checkpoint(d_checkpoint->wait());
+        }
+        return !d_has_old;
+    }
+
+    // The number of the last group committed, and of the last synced to disk.
+    [[nodiscard]] std::uint64_t committed() const noexcept
+    {
+        return d_committed;
+    }
+
+    [[nodiscard]] std::uint64_t durable() const
+    {
+        std::lock_guard lock{d_mutex};
+        return d_durable;
+    }
+
+    // The number of times the log has been synced, which is at most the number of
+    // commits.
+    [[nodiscard]] std::size_t syncs() const
+    {
+        std::lock_guard lock{d_mutex};
+        return d_syncs;
+    }
+
+    // Returns false if writing the log has failed, after which nothing more is logged.
+    [[nodiscard]] bool ok() const
+    {
+        std::lock_guard lock{d_mutex};
+        return !d_failed;
+    }
+};
+
+// Restores the registry after a crash from the checkpoint and the log that a
+// write_ahead_log kept at the given paths: the checkpoint is loaded, or the registry
+// cleared if there is none, and then every complete group in the log is replayed on top
+// of it. A group that was being written during the crash is ignored. Returns false if
+// the checkpoint or the log cannot be read, or they do not match each other or the
+// registry's components.
+template <typename... Comps>
+bool recover(const std::string& checkpoint_path, const std::string& log_path, apx::registry<Comps...>& reg)
+{
+    std::uint64_t label = 0;
+    if (std::filesystem::exists(checkpoint_path)) {
+        const auto saved = apx::checkpoint_label(checkpoint_path);
+        if (!saved || !apx::load_checkpoint(checkpoint_path, reg)) {
+            return false;
+        }
+        label = *saved;
+    } else {
+        reg.clear();
+    }
+
+    // The old log is left while a checkpoint is being written, and only needs replaying
+    // if the crash came before the checkpoint was complete.
+    bool first = true;
+    for (const std::string& path : {log_path + ".old", log_path}) {
+        const auto contents = apx::detail::read_file(path);
+        if (!contents) {
+            continue;
+        }
+        const auto bytes = std::as_bytes(std::span{*contents});
+        const auto base = apx::detail::log_base(bytes);
+        if (!base || *base < label) {
+            continue;
+        }
+        if (first && *base != label) {
+            return false;
+        }
+        first = false;
+
+        apx::byte_reader in{bytes.subspan(apx::detail::wal_header_size)};
+        while (!in.done()) {
+            const auto size = in.raw<std::uint64_t>();
+            const auto hash = in.raw<std::uint64_t>();
+            const std::byte* records = in.ok() ? in.bytes(size) : nullptr;
+            if (!records || apx::detail::wal_hash({records, size}) != hash) {
+                break;
+            }
+            if (!apx::detail::replay({records, size}, reg)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+}
+
+#endif // APECS_WAL_HPP_
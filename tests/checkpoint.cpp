@@ -0,0 +1,135 @@
+#include <apecs/checkpoint.hpp>
+#include <gtest/gtest.h>
+
+#include <filesystem>
+
+namespace {
+
+struct position { int x = 0; int y = 0; };
+struct tag {};
+
+using registry_type = apx::registry<position, tag>;
+
+std::string temp_path(const char* name)
+{
+    return (std::filesystem::path{::testing::TempDir()} / name).string();
+}
+
+// Everything about the registry that a checkpoint should keep, including the order of
+// its storage and pool.
+auto snapshot(const registry_type& reg)
+{
+    std::vector<apx::entity> entities{reg.all().begin(), reg.all().end()};
+    std::vector<apx::entity> pool{reg.pool().begin(), reg.pool().end()};
+    std::vector<std::tuple<apx::entity, int, int>> positions;
+    for (const auto [entity, p] : reg.storage<position>().each()) {
+        positions.emplace_back(entity, p.x, p.y);
+    }
+    const auto tags = reg.storage<tag>().keys();
+    return std::make_tuple(entities, pool, positions, std::vector<apx::entity>{tags.begin(), tags.end()});
+}
+
+registry_type make_world()
+{
+    registry_type reg;
+    std::vector<apx::entity> entities;
+    for (int i = 0; i != 100; ++i) {
+        entities.push_back(reg.create_with(position{i, -i}));
+        if (i % 3 == 0) {
+            reg.add<tag>(entities.back(), {});
+        }
+    }
+    for (int i = 0; i < 100; i += 7) {
+        reg.destroy(entities[i]);
+    }
+    reg.remove<position>(entities[50]);
+    return reg;
+}
+
+}
+
+TEST(checkpoint, forked_checkpoint_keeps_the_registry_as_it_was)
+{
+    auto reg = make_world();
+    const auto expected = snapshot(reg);
+    const auto path = temp_path("apecs_forked.ckpt");
+
+    auto handle = apx::checkpoint_async(reg, path);
+
+    // Changing the registry straight away does not affect the checkpoint.
+    for (const auto [entity, p] : reg.storage<position>().each()) {
+        reg.patch<position>(entity, [](position& q) { q.x = 1000; });
+    }
+    reg.destroy(reg.from_index(1));
+
+    ASSERT_EQ(handle.wait(), apx::checkpoint_status::done);
+    ASSERT_EQ(handle.poll(), apx::checkpoint_status::done);
+
+    registry_type loaded;
+    ASSERT_TRUE(apx::load_checkpoint(path, loaded));
+    ASSERT_EQ(snapshot(loaded), expected);
+    std::filesystem::remove(path);
+}
+
+TEST(checkpoint, blocking_checkpoint_round_trips)
+{
+    const auto reg = make_world();
+    const auto path = temp_path("apecs_blocking.ckpt");
+
+    auto handle = apx::checkpoint_async(reg, path, apx::checkpoint_mode::blocking);
+    ASSERT_EQ(handle.poll(), apx::checkpoint_status::done);
+
+    registry_type loaded;
+    ASSERT_TRUE(apx::load_checkpoint(path, loaded));
+    ASSERT_EQ(snapshot(loaded), snapshot(reg));
+
+    // Entities are recycled the same way after loading.
+    auto copy = reg;
+    ASSERT_EQ(loaded.create(), copy.create());
+    std::filesystem::remove(path);
+}
+
+TEST(checkpoint, loading_rejects_bad_files)
+{
+    registry_type reg;
+    ASSERT_FALSE(apx::load_checkpoint(temp_path("apecs_missing.ckpt"), reg));
+
+    const auto path = temp_path("apecs_truncated.ckpt");
+    ASSERT_TRUE(apx::save_checkpoint(make_world(), path));
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 3);
+    ASSERT_FALSE(apx::load_checkpoint(path, reg));
+    ASSERT_EQ(reg.size(), 0);
+
+    // A registry of other components cannot load it.
+    apx::registry<position> other;
+    std::filesystem::remove(path);
+    ASSERT_TRUE(apx::save_checkpoint(make_world(), path));
+    ASSERT_FALSE(apx::load_checkpoint(path, other));
+    std::filesystem::remove(path);
+}
+
+TEST(checkpoint, overlapping_checkpoints_to_one_path_do_not_tear)
+{
+    auto reg = make_world();
+    const auto dir = std::filesystem::path{temp_path("apecs_overlapping")};
+    std::filesystem::create_directories(dir);
+    const auto path = (dir / "world.ckpt").string();
+
+    // A forked save still running while another starts, of a different registry.
+    const auto before = snapshot(reg);
+    auto forked = apx::checkpoint_async(reg, path);
+    reg.destroy(reg.from_index(1));
+    ASSERT_TRUE(apx::save_checkpoint(reg, path));
+    auto blocking = apx::checkpoint_async(reg, path, apx::checkpoint_mode::blocking);
+    ASSERT_EQ(blocking.poll(), apx::checkpoint_status::done);
+    ASSERT_EQ(forked.wait(), apx::checkpoint_status::done);
+
+    // Whichever finished last, the file holds one of them whole, and no temporary
+    // files are left behind.
+    registry_type loaded;
+    ASSERT_TRUE(apx::load_checkpoint(path, loaded));
+    const auto saved = snapshot(loaded);
+    ASSERT_TRUE(saved == before || saved == snapshot(reg));
+    ASSERT_EQ(std::distance(std::filesystem::directory_iterator{dir}, std::filesystem::directory_iterator{}), 1);
+    std::filesystem::remove_all(dir);
+}
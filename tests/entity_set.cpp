@@ -0,0 +1,71 @@
+#include <apecs/apecs.hpp>
+#include <gtest/gtest.h>
+
+namespace {
+
+// Kept local so as not to clash with the components of the same name in registry.cpp.
+struct foo {};
+struct bar {};
+struct baz {};
+
+}
+
+TEST(entity_set, materialise_from_view)
+{
+    apx::registry<foo, bar, baz> reg;
+
+    auto e1 = reg.create();
+    auto e2 = reg.create();
+    auto e3 = reg.create();
+    reg.emplace<foo>(e3);
+    reg.emplace<foo>(e1);
+    reg.emplace<foo>(e2);
+    reg.emplace<bar>(e1);
+    reg.emplace<bar>(e3);
+
+    apx::entity_set set{reg.view<foo, bar>()};
+    ASSERT_EQ(set.size(), 2);
+    ASSERT_TRUE(set.contains(e1));
+    ASSERT_FALSE(set.contains(e2));
+    ASSERT_TRUE(std::ranges::is_sorted(set));
+}
+
+TEST(entity_set, set_algebra)
+{
+    apx::registry<foo, bar, baz> reg;
+
+    std::vector<apx::entity> entities;
+    for (int i = 0; i != 30; ++i) {
+        auto e = entities.emplace_back(reg.create());
+        if (i % 2 == 0) reg.emplace<foo>(e);
+        if (i % 3 == 0) reg.emplace<bar>(e);
+        if (i % 5 == 0) reg.emplace<baz>(e);
+    }
+
+    const apx::entity_set foos{reg.view<foo>()};
+    const apx::entity_set bars{reg.view<bar>()};
+    const apx::entity_set bazs{reg.view<baz>()};
+
+    ASSERT_EQ(foos & bars, apx::entity_set{(reg.view<foo, bar>())});
+    ASSERT_EQ((foos & bars) - bazs, apx::entity_set(std::vector{
+        entities[6], entities[12], entities[18], entities[24]
+    }));
+    ASSERT_EQ((foos | bars).size(), 20);
+}
+
+TEST(entity_set, reuse_keeps_contents_independent)
+{
+    apx::registry<foo, bar, baz> reg;
+    auto e1 = reg.create();
+    auto e2 = reg.create();
+    reg.emplace<foo>(e1);
+    reg.emplace<foo>(e2);
+    reg.emplace<bar>(e2);
+
+    apx::entity_set set{reg.view<foo>()};
+    ASSERT_EQ(set.size(), 2);
+
+    set.assign(reg.view<bar>());
+    ASSERT_EQ(set.size(), 1);
+    ASSERT_TRUE(set.contains(e2));
+}
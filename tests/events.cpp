@@ -0,0 +1,108 @@
+#include <apecs/events.hpp>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+struct damage { apx::entity target; int amount; };
+struct spawned { int kind; };
+
+using bus_type = apx::event_bus<damage, spawned>;
+
+std::vector<int> amounts(const std::span<const damage> events)
+{
+    std::vector<int> out;
+    for (const damage& d : events) {
+        out.push_back(d.amount);
+    }
+    return out;
+}
+
+}
+
+TEST(events, events_are_read_the_frame_after_they_are_sent)
+{
+    bus_type bus{8};
+    apx::event_reader<damage> first;
+    apx::event_reader<damage> second;
+
+    bus.send(damage{apx::null, 1});
+    bus.send(damage{apx::null, 2});
+    bus.send(spawned{7});
+    ASSERT_TRUE(bus.read(first).empty());
+
+    bus.end_frame();
+    bus.send(damage{apx::null, 3});
+    ASSERT_EQ(amounts(bus.read(first)), (std::vector{1, 2}));
+    ASSERT_TRUE(bus.read(first).empty());
+    ASSERT_EQ(amounts(bus.read(second)), (std::vector{1, 2}));
+    ASSERT_EQ(bus.channel<spawned>().events().size(), 1);
+
+    // A reader that skips a frame misses its events.
+    bus.end_frame();
+    bus.end_frame();
+    ASSERT_TRUE(bus.read(first).empty());
+    ASSERT_TRUE(bus.channel<spawned>().events().empty());
+}
+
+TEST(events, senders_on_several_threads_are_all_delivered)
+{
+    constexpr int per_thread = 10'000;
+    apx::event_channel<damage> channel{4 * per_thread};
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t != 4; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i != per_thread; ++i) {
+                ASSERT_TRUE(channel.send(damage{apx::null, t * per_thread + i}));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    channel.end_frame();
+
+    auto received = amounts(channel.events());
+    std::ranges::sort(received);
+    ASSERT_EQ(received.size(), 4 * per_thread);
+    for (int i = 0; i != 4 * per_thread; ++i) {
+        ASSERT_EQ(received[i], i);
+    }
+}
+
+TEST(events, full_frames_drop_events_and_grow)
+{
+    apx::event_channel<damage> channel{4};
+    const std::vector<damage> batch(10, damage{apx::null, 5});
+
+    ASSERT_EQ(channel.send(batch), 4);
+    ASSERT_FALSE(channel.send(damage{apx::null, 6}));
+    channel.end_frame();
+    ASSERT_EQ(channel.events().size(), 4);
+    ASSERT_EQ(channel.dropped(), 7);
+
+    // Both buffers have grown by the time the next frame is read.
+    for (int frame = 0; frame != 2; ++frame) {
+        ASSERT_EQ(channel.send(batch), 10);
+        channel.end_frame();
+        ASSERT_EQ(channel.events().size(), 10);
+    }
+    ASSERT_EQ(channel.dropped(), 7);
+}
+
+TEST(events, sending_to_a_full_frame_drops_everything)
+{
+    apx::event_channel<damage> channel{4};
+    const std::vector<damage> triple(3, damage{apx::null, 7});
+
+    ASSERT_EQ(channel.send(triple), 3);
+    ASSERT_EQ(channel.send(triple), 1);
+    ASSERT_EQ(channel.send(triple), 0);
+    ASSERT_FALSE(channel.send(damage{apx::null, 8}));
+    channel.end_frame();
+    ASSERT_EQ(channel.events().size(), 4);
+    ASSERT_EQ(channel.dropped(), 6);
+}
@@ -0,0 +1,129 @@
+#include <apecs/recorder.hpp>
+#include <gtest/gtest.h>
+
+namespace {
+
+struct position { float x = 0.0f; float y = 0.0f; };
+struct velocity { float x = 0.0f; float y = 0.0f; };
+struct name { int id = 0; };
+
+using registry_type = apx::registry<position, velocity, name>;
+using recorder_type = apx::recorder<registry_type, position, velocity>;
+
+// The recorded components of the registry, position by position.
+std::vector<std::tuple<apx::entity, float, float>> positions_of(const registry_type& reg)
+{
+    std::vector<std::tuple<apx::entity, float, float>> out;
+    for (const auto [entity, p] : reg.storage<position>().each()) {
+        out.emplace_back(entity, p.x, p.y);
+    }
+    return out;
+}
+
+std::vector<std::tuple<apx::entity, float, float>> positions_of(const apx::recorded_frame<position, velocity>& frame)
+{
+    std::vector<std::tuple<apx::entity, float, float>> out;
+    const auto& column = frame.get<position>();
+    for (std::size_t i = 0; i != column.keys.size(); ++i) {
+        out.emplace_back(column.keys[i], column.values[i].x, column.values[i].y);
+    }
+    return out;
+}
+
+// Moves half of the entities each frame, and stops one every ten frames.
+void step(registry_type& reg, const int frame)
+{
+    for (auto [p, v] : reg.view_get<position, velocity>()) {
+        if (static_cast<int>(v.x) % 2 == frame % 2) {
+            p.x += v.x;
+            p.y += v.y;
+        }
+    }
+    if (frame % 10 == 9) {
+        reg.remove<velocity>(reg.storage<velocity>().keys().front());
+    }
+}
+
+}
+
+TEST(recorder, frames_read_back_as_captured)
+{
+    registry_type reg;
+    for (int i = 0; i != 100; ++i) {
+        static_cast<void>(reg.create_with(position{}, velocity{static_cast<float>(i), 1.0f}, name{i}));
+    }
+
+    recorder_type recorder{40, 8, 200};
+    std::vector<std::vector<std::tuple<apx::entity, float, float>>> expected;
+    for (int frame = 0; frame != 100; ++frame) {
+        step(reg, frame);
+        ASSERT_TRUE(recorder.capture(reg));
+        expected.push_back(positions_of(reg));
+    }
+    recorder.flush();
+
+    const auto frames = recorder.frames();
+    ASSERT_TRUE(frames);
+    ASSERT_EQ(frames->second, 99);
+    ASSERT_LE(frames->first, 60);
+    ASSERT_GE(frames->first, 52);
+    ASSERT_FALSE(recorder.contains(frames->first - 1));
+
+    for (std::uint64_t number = frames->first; number <= frames->second; ++number) {
+        const auto frame = recorder.read(number);
+        ASSERT_TRUE(frame);
+        ASSERT_EQ(positions_of(*frame), expected[number]);
+        ASSERT_EQ(frame->get<velocity>().keys.size(), 100 - (number + 1) / 10);
+    }
+
+    // Only the positions that moved are kept between keyframes.
+    const std::size_t raw = (frames->second - frames->first + 1) * 100 * (sizeof(position) + sizeof(velocity) + 2 * sizeof(apx::entity));
+    ASSERT_LT(recorder.encoded_bytes(), raw / 2);
+}
+
+TEST(recorder, restore_puts_components_back)
+{
+    registry_type reg;
+    for (int i = 0; i != 20; ++i) {
+        static_cast<void>(reg.create_with(position{}, velocity{static_cast<float>(i), 2.0f}));
+    }
+
+    recorder_type recorder{64, 8, 30};
+    for (int frame = 0; frame != 30; ++frame) {
+        step(reg, frame);
+        recorder.capture(reg);
+    }
+    recorder.flush();
+
+    const auto frame = recorder.read(12);
+    ASSERT_TRUE(frame);
+    ASSERT_TRUE(recorder.restore(12, reg));
+    ASSERT_EQ(positions_of(reg), positions_of(*frame));
+    ASSERT_EQ(reg.storage<velocity>().size(), 19);
+    ASSERT_FALSE(recorder.restore(1000, reg));
+}
+
+TEST(recorder, frames_are_dropped_rather_than_waited_for)
+{
+    registry_type reg;
+    for (int i = 0; i != 10000; ++i) {
+        static_cast<void>(reg.create_with(position{}, velocity{static_cast<float>(i), 1.0f}));
+    }
+
+    recorder_type recorder{16, 4, 1};
+    std::size_t captured = 0;
+    for (int frame = 0; frame != 50; ++frame) {
+        captured += recorder.capture(reg);
+    }
+    recorder.flush();
+    ASSERT_EQ(captured + recorder.dropped(), 50);
+
+    // Whatever was kept can still be read.
+    const auto frames = recorder.frames();
+    ASSERT_TRUE(frames);
+    for (std::uint64_t number = frames->first; number <= frames->second; ++number) {
+        if (recorder.contains(number)) {
+            ASSERT_TRUE(recorder.read(number));
+        }
+    }
+}
@@ -1,6 +1,9 @@
 #include <apecs/apecs.hpp>
 #include <gtest/gtest.h>
 
+#include <memory>
+#include <string>
+
 struct foo { int value = 0; };
 struct bar {};
 
@@ -100,6 +103,31 @@ TEST(registry, test_add)
     }
 }
 
+TEST(registry, create_with_components)
+{
+    apx::registry<foo, bar> reg;
+
+    foo f{3};
+    auto e1 = reg.create_with(f, bar{});
+    ASSERT_TRUE((reg.has_all<foo, bar>(e1)));
+    ASSERT_EQ(reg.get<foo>(e1).value, 3);
+
+    auto e2 = reg.create_with(foo{4});
+    ASSERT_TRUE(reg.has<foo>(e2));
+    ASSERT_FALSE(reg.has<bar>(e2));
+}
+
+TEST(registry, emplace_all_components)
+{
+    apx::registry<foo, bar> reg;
+    auto e = reg.create();
+
+    auto [f, b] = reg.emplace_all<foo, bar>(e, 5, bar{});
+    ASSERT_EQ(&f, &reg.get<foo>(e));
+    ASSERT_EQ(&b, &reg.get<bar>(e));
+    ASSERT_EQ(f.value, 5);
+}
+
 TEST(registry, multi_destroy_vector)
 {
     apx::registry<foo> reg;
@@ -163,6 +191,414 @@ TEST(registry_iteration, view_for_loop_multi)
     ASSERT_EQ(count, 2);
 }
 
+TEST(registry_iteration, view_merge_join_matches_probe_join)
+{
+    apx::registry<foo, bar> reg;
+
+    for (int i = 0; i != 100; ++i) {
+        auto e = reg.create();
+        if (i % 2 == 0) reg.emplace<foo>(e, i);
+        if (i % 3 == 0) reg.emplace<bar>(e);
+    }
+
+    auto probed = reg.view<foo, bar>().using_strategy(apx::join_strategy::probe);
+    auto merged = reg.view<foo, bar>().using_strategy(apx::join_strategy::merge);
+    ASSERT_TRUE(std::ranges::equal(merged, probed));
+    ASSERT_EQ(std::ranges::distance(merged), 17);
+}
+
+TEST(registry_iteration, view_merges_large_sparse_sorted_sets)
+{
+    apx::registry<foo, bar> reg;
+
+    std::vector<apx::entity> entities;
+    for (int i = 0; i != 1 << 18; ++i) {
+        auto e = entities.emplace_back(reg.create());
+        if (i % 64 == 0) {
+            reg.emplace<foo>(e);
+            reg.emplace<bar>(e);
+        }
+    }
+    auto sorted = reg.view<foo, bar>();
+    ASSERT_EQ(sorted.strategy(), apx::join_strategy::merge);
+    ASSERT_EQ(std::ranges::distance(sorted), 4096);
+
+    reg.remove<foo>(entities[0]);
+    auto unsorted = reg.view<foo, bar>();
+    ASSERT_EQ(unsorted.strategy(), apx::join_strategy::probe);
+    ASSERT_EQ(std::ranges::distance(unsorted), 4095);
+
+    reg.sort<foo>();
+    auto resorted = reg.view<foo, bar>();
+    ASSERT_EQ(resorted.strategy(), apx::join_strategy::merge);
+    ASSERT_EQ(std::ranges::distance(resorted), 4095);
+}
+
+TEST(registry_iteration, view_bitmap_join_visits_in_index_order)
+{
+    apx::registry<foo, bar> reg;
+    reg.enable_bitmap<foo>();
+    reg.enable_bitmap<bar>();
+
+    std::vector<apx::entity> entities;
+    for (int i = 0; i != 10000; ++i) {
+        auto e = entities.emplace_back(reg.create());
+        if (i % 2 == 0) reg.emplace<foo>(e, i);
+        if (i % 3 == 0) reg.emplace<bar>(e);
+    }
+    reg.remove<foo>(entities[0]);
+
+    auto v = reg.view<foo, bar>();
+    ASSERT_EQ(v.strategy(), apx::join_strategy::bitmap);
+
+    std::vector<apx::entity> expected;
+    for (int i = 6; i < 10000; i += 6) {
+        expected.push_back(entities[i]);
+    }
+    ASSERT_TRUE(std::ranges::equal(v, expected));
+}
+
+TEST(registry_iteration, view_prefetch_does_not_change_results)
+{
+    apx::registry<foo, bar> reg;
+
+    std::vector<apx::entity> entities;
+    for (int i = 0; i != 1000; ++i) {
+        entities.push_back(reg.create());
+    }
+    for (auto it = entities.rbegin(); it != entities.rend(); ++it) {
+        reg.emplace<foo>(*it);
+    }
+    for (std::size_t i = 0; i < entities.size(); i += 3) {
+        reg.emplace<bar>(entities[i]);
+    }
+
+    auto plain = reg.view<foo, bar>().with_prefetch(0);
+    auto prefetched = plain.with_prefetch(8);
+    ASSERT_EQ(prefetched.prefetch(), 8);
+    ASSERT_TRUE(std::ranges::equal(plain, prefetched));
+    ASSERT_EQ(std::ranges::distance(prefetched), 334);
+}
+
+TEST(registry_iteration, single_component_view_is_random_access)
+{
+    apx::registry<foo, bar> reg;
+    auto e1 = reg.create();
+    auto e2 = reg.create();
+    reg.emplace<foo>(e1);
+    reg.emplace<foo>(e2);
+
+    auto v = reg.view<foo>();
+    static_assert(std::ranges::random_access_range<decltype(v)>);
+    static_assert(std::ranges::sized_range<decltype(v)>);
+    ASSERT_EQ(v.size(), 2);
+    ASSERT_EQ(v[1], e2);
+}
+
+TEST(registry_iteration, view_chunks_partition_the_view)
+{
+    apx::registry<foo, bar> reg;
+    reg.enable_bitmap<foo>();
+    reg.enable_bitmap<bar>();
+
+    for (int i = 0; i != 1000; ++i) {
+        auto e = reg.create();
+        if (i % 2 == 0) reg.emplace<foo>(e);
+        if (i % 3 == 0) reg.emplace<bar>(e);
+    }
+
+    for (auto strategy : {apx::join_strategy::probe, apx::join_strategy::merge, apx::join_strategy::bitmap}) {
+        auto v = reg.view<foo, bar>().using_strategy(strategy);
+        ASSERT_EQ(v.driving_size(), 334);
+
+        std::vector<apx::entity> chunked;
+        for (std::size_t i = 0; i != 7; ++i) {
+            std::ranges::copy(v.chunk(i, 7), std::back_inserter(chunked));
+        }
+        ASSERT_EQ(apx::entity_set{chunked}, apx::entity_set{v});
+        ASSERT_EQ(chunked.size(), 167);
+    }
+}
+
+TEST(registry_iteration, view_yields_versioned_entities)
+{
+    apx::registry<foo, bar> reg;
+
+    auto e1 = reg.create();
+    reg.destroy(e1);
+    auto e2 = reg.create();
+    ASSERT_EQ(apx::to_index(e1), apx::to_index(e2));
+    reg.emplace<foo>(e2);
+    reg.emplace<bar>(e2);
+
+    ASSERT_EQ(reg.view<foo>()[0], e2);
+    auto v = reg.view<foo, bar>();
+    ASSERT_EQ(*v.begin(), e2);
+    ASSERT_EQ(reg.find<foo>(), e2);
+}
+
+TEST(registry_iteration, view_get_can_modify_components)
+{
+    apx::registry<foo, bar> reg;
+    reg.enable_bitmap<foo>();
+    reg.enable_bitmap<bar>();
+
+    for (int i = 0; i != 100; ++i) {
+        auto e = reg.create();
+        reg.emplace<foo>(e, i);
+        if (i % 4 == 0) reg.emplace<bar>(e);
+    }
+
+    for (auto [f] : reg.view_get<foo>()) {
+        f.value += 1;
+    }
+    for (auto [f, b] : reg.view_get<foo, bar>()) {
+        f.value *= 2;
+    }
+
+    const auto& creg = reg;
+    for (auto [f] : creg.view_get<foo>()) {
+        static_assert(std::is_same_v<decltype(f), const foo&>);
+    }
+
+    int total = 0;
+    for (auto [f, b] : creg.view_get<foo, bar>()) {
+        static_assert(std::is_same_v<decltype(f), const foo&>);
+        total += f.value;
+    }
+    ASSERT_EQ(total, 2 * (1 + 5 + 9 + 13 + 17 + 21 + 25 + 29 + 33 + 37 + 41 + 45 + 49 + 53 + 57 + 61 + 65 + 69 + 73 + 77 + 81 + 85 + 89 + 93 + 97));
+}
+
+TEST(registry_iteration, view_components_match_across_strategies)
+{
+    apx::registry<foo, bar> reg;
+    reg.enable_bitmap<foo>();
+    reg.enable_bitmap<bar>();
+
+    for (int i = 0; i != 100; ++i) {
+        auto e = reg.create();
+        reg.emplace<foo>(e, i);
+        if (i % 3 == 0) reg.emplace<bar>(e);
+    }
+
+    for (auto strategy : {apx::join_strategy::probe, apx::join_strategy::merge, apx::join_strategy::bitmap}) {
+        auto v = reg.view<foo, bar>().using_strategy(strategy);
+        for (auto it = v.begin(); it != v.end(); ++it) {
+            auto [f, b] = it.components();
+            ASSERT_EQ(&f, &reg.get<foo>(*it));
+            ASSERT_EQ(&b, &reg.get<bar>(*it));
+        }
+    }
+}
+
+TEST(registry_iteration, view_get_yields_optional_components_as_pointers)
+{
+    apx::registry<foo, bar> reg;
+
+    std::vector<apx::entity> entities;
+    for (int i = 0; i != 100; ++i) {
+        auto e = entities.emplace_back(reg.create());
+        reg.emplace<foo>(e, i);
+        if (i % 3 == 0) reg.emplace<bar>(e);
+    }
+
+    int visited = 0;
+    for (auto [f, b] : reg.view_get<foo, apx::optional<bar>>()) {
+        static_assert(std::is_same_v<decltype(b), bar*>);
+        ASSERT_EQ(b, reg.get_if<bar>(entities[f.value]));
+        ++visited;
+    }
+    ASSERT_EQ(visited, 100);
+
+    // The optional component need not come last, and does not drive the view even
+    // though its set is the smaller one.
+    const auto& creg = reg;
+    int with_bar = 0;
+    for (auto [b, f] : creg.view_get<apx::optional<bar>, foo>()) {
+        static_assert(std::is_same_v<decltype(b), const bar*>);
+        static_assert(std::is_same_v<decltype(f), const foo&>);
+        with_bar += b != nullptr;
+    }
+    ASSERT_EQ(with_bar, 34);
+}
+
+TEST(registry_iteration, optional_components_do_not_affect_the_strategy)
+{
+    struct baz { int value = 0; };
+    apx::registry<foo, bar, baz> reg;
+    reg.enable_bitmap<foo>();
+    reg.enable_bitmap<bar>();
+
+    for (int i = 0; i != 100; ++i) {
+        auto e = reg.create();
+        reg.emplace<foo>(e, i);
+        if (i % 2 == 0) reg.emplace<bar>(e);
+        if (i % 5 == 0) reg.emplace<baz>(e, i);
+    }
+
+    auto v = reg.view_get<foo, bar, apx::optional<baz>>();
+    int count = 0;
+    for (auto [f, b, z] : v) {
+        ASSERT_EQ(f.value % 2, 0);
+        ASSERT_EQ(z != nullptr, f.value % 5 == 0);
+        if (z) {
+            ASSERT_EQ(z->value, f.value);
+        }
+        ++count;
+    }
+    ASSERT_EQ(count, 50);
+}
+
+TEST(registry_iteration, runtime_view_matches_static_view)
+{
+    struct baz { int value = 0; };
+    apx::registry<foo, bar, baz> reg;
+    reg.enable_bitmap<bar>();
+
+    for (int i = 0; i != 100; ++i) {
+        auto e = reg.create();
+        if (i % 2 == 0) reg.emplace<foo>(e, i);
+        if (i % 3 == 0) reg.emplace<bar>(e);
+        if (i % 5 == 0) reg.emplace<baz>(e, -i);
+    }
+
+    using reg_type = decltype(reg);
+    const std::vector<apx::component_id> ids{reg_type::id_of<baz>(), reg_type::id_of<bar>(), reg_type::id_of<foo>()};
+    auto rv = reg.runtime_view(ids);
+
+    std::vector<apx::entity> expected;
+    std::ranges::copy(reg.view<foo, bar, baz>(), std::back_inserter(expected));
+    std::ranges::sort(expected);
+
+    std::vector<apx::entity> actual;
+    for (auto it = rv.begin(); it != rv.end(); ++it) {
+        actual.push_back(*it);
+        ASSERT_EQ(it.component(0), &reg.get<baz>(*it));
+        ASSERT_EQ(it.component(2), &reg.get<foo>(*it));
+        ASSERT_EQ(static_cast<baz*>(it.component(0))->value, -static_cast<foo*>(it.component(2))->value);
+    }
+    std::ranges::sort(actual);
+    ASSERT_EQ(actual, expected);
+    ASSERT_EQ(actual.size(), 4);
+}
+
+TEST(registry_iteration, where_filters_on_component_values)
+{
+    struct baz { int value = 0; };
+    apx::registry<foo, bar, baz> reg;
+
+    for (int i = 0; i != 100; ++i) {
+        auto e = reg.create();
+        reg.emplace<foo>(e, i);
+        if (i % 2 == 0) reg.emplace<bar>(e);
+        if (i % 3 == 0) reg.emplace<baz>(e, i % 7);
+    }
+
+    auto v = reg.view<foo, bar>().where<foo>([](const foo& f) { return f.value >= 90; });
+    std::vector<int> values;
+    for (auto [f, b] : v.components()) {
+        values.push_back(f.value);
+    }
+    std::ranges::sort(values);
+    ASSERT_EQ(values, (std::vector<int>{90, 92, 94, 96, 98}));
+
+    // Clauses on several components each narrow the last one's selection.
+    auto w = reg.view<foo, baz>()
+        .where<foo>([](const foo& f) { return f.value < 50; })
+        .where<baz>([](const baz& z) { return z.value == 0; });
+    values.clear();
+    for (auto e : w) {
+        values.push_back(reg.get<foo>(e).value);
+        ASSERT_EQ(reg.get<baz>(e).value, 0);
+    }
+    std::ranges::sort(values);
+    ASSERT_EQ(values, (std::vector<int>{0, 21, 42}));
+
+    // Filtering a slice only keeps the entities of that slice.
+    const auto whole = reg.view<foo, bar>();
+    const auto part = whole.slice(0, whole.driving_size() / 2);
+    std::vector<apx::entity> expected;
+    for (auto e : part) {
+        if (reg.get<foo>(e).value % 4 == 0) {
+            expected.push_back(e);
+        }
+    }
+    std::vector<apx::entity> actual;
+    for (auto e : part.where<foo>([](const foo& f) { return f.value % 4 == 0; })) {
+        actual.push_back(e);
+    }
+    std::ranges::sort(expected);
+    std::ranges::sort(actual);
+    ASSERT_FALSE(expected.empty());
+    ASSERT_EQ(actual, expected);
+}
+
+TEST(registry_iteration, view_sorted_orders_by_key)
+{
+    apx::registry<foo, bar> reg;
+
+    std::vector<apx::entity> entities;
+    for (int i = 0; i != 50; ++i) {
+        entities.push_back(reg.create_with(foo{(i * 37) % 50}));
+    }
+    const auto positions = reg.view<foo>();
+    const std::vector<apx::entity> storage_order{positions.begin(), positions.end()};
+
+    const auto value = [](const foo& f) { return f.value; };
+    const auto is_ordered = [&](std::span<const apx::entity> order) {
+        return std::ranges::is_sorted(order, {}, [&](apx::entity e) { return reg.get<foo>(e).value; });
+    };
+
+    auto order = reg.view_sorted<foo>(value);
+    ASSERT_EQ(order.size(), 50);
+    ASSERT_TRUE(is_ordered(order));
+    ASSERT_EQ(reg.get<foo>(order[0]).value, 0);
+
+    // The storage itself is left alone.
+    ASSERT_TRUE(std::ranges::equal(reg.view<foo>(), storage_order));
+
+    // Nudge some keys, and add and remove entities.
+    reg.get<foo>(entities[3]).value += 2;
+    reg.get<foo>(entities[10]).value -= 3;
+    reg.destroy(entities[20]);
+    static_cast<void>(reg.create_with(foo{25}));
+    static_cast<void>(reg.create_with(foo{-1}));
+
+    order = reg.view_sorted<foo>(value);
+    ASSERT_EQ(order.size(), 51);
+    ASSERT_TRUE(is_ordered(order));
+    ASSERT_EQ(std::ranges::find(order, entities[20]), order.end());
+    ASSERT_EQ(reg.get<foo>(order[0]).value, -1);
+
+    // A key that reverses the order needs more than the insertion sort allows.
+    order = reg.view_sorted<foo>([](const foo& f) { return -f.value; });
+    ASSERT_EQ(reg.get<foo>(order[0]).value, 49);
+    ASSERT_TRUE(std::ranges::is_sorted(order, std::greater<>{}, [&](apx::entity e) { return reg.get<foo>(e).value; }));
+
+    // Each key keeps its own order, so alternating between them does not disturb the
+    // order of ties under the other.
+    const auto tens = [](const foo& f) { return f.value / 10; };
+    order = reg.view_sorted<foo>(tens);
+    const std::vector<apx::entity> first{order.begin(), order.end()};
+    order = reg.view_sorted<foo>(value);
+    ASSERT_TRUE(is_ordered(order));
+    order = reg.view_sorted<foo>(tens);
+    ASSERT_TRUE(std::ranges::equal(order, first));
+
+    // A key that throws part way through leaves nothing behind for the next call.
+    int calls = 0;
+    const auto fussy = [&calls](const foo& f) {
+        if (++calls == 10) {
+            throw 0;
+        }
+        return f.value;
+    };
+    ASSERT_THROW(static_cast<void>(reg.view_sorted<foo>(fussy)), int);
+    order = reg.view_sorted<foo>(fussy);
+    ASSERT_EQ(order.size(), 51);
+    ASSERT_TRUE(is_ordered(order));
+}
+
 TEST(registry_iteration, all_for_loop)
 {
     apx::registry<foo, bar> reg;
@@ -181,6 +617,419 @@ TEST(registry_iteration, all_for_loop)
     ASSERT_EQ(count, 2);
 }
 
+TEST(registry, gather_and_scatter_components)
+{
+    struct baz { int value = 0; };
+    apx::registry<foo, bar, baz> reg;
+
+    std::vector<apx::entity> entities;
+    for (int i = 0; i != 1000; ++i) {
+        entities.push_back(reg.create_with(foo{i}, baz{-i}));
+    }
+    std::vector<apx::entity> query;
+    for (std::size_t i = 0; i < entities.size(); i += 3) {
+        query.push_back(entities[(i * 7) % entities.size()]);
+    }
+    ASSERT_TRUE(reg.valid(query));
+
+    std::vector<foo> foos(query.size());
+    std::vector<baz> bazs(query.size());
+    reg.gather<foo, baz>(query, foos, bazs);
+    for (std::size_t i = 0; i != query.size(); ++i) {
+        ASSERT_EQ(foos[i].value, reg.get<foo>(query[i]).value);
+        ASSERT_EQ(bazs[i].value, -foos[i].value);
+        foos[i].value *= 2;
+    }
+
+    reg.scatter<foo>(query, foos);
+    for (std::size_t i = 0; i != query.size(); ++i) {
+        ASSERT_EQ(reg.get<foo>(query[i]).value, -2 * reg.get<baz>(query[i]).value);
+    }
+
+    reg.destroy(query[5]);
+    ASSERT_FALSE(reg.valid(query));
+}
+
+TEST(registry_reduction, reductions_over_components)
+{
+    apx::registry<foo, bar> reg;
+    for (int i = 0; i != 100; ++i) {
+        auto e = reg.create();
+        reg.emplace<foo>(e, i);
+        if (i % 4 == 0) reg.emplace<bar>(e);
+    }
+
+    const auto value = [](const foo& f) { return f.value; };
+    ASSERT_EQ(reg.sum<foo>(value), 4950);
+    ASSERT_EQ(reg.reduce<foo>(1000, value, std::plus<>{}), 5950);
+    ASSERT_EQ(reg.min<foo>(value), 0);
+    ASSERT_EQ(reg.max<foo>(value), 99);
+    ASSERT_EQ((reg.sum<foo, bar>([](const foo& f, const bar&) { return f.value; })), 1200);
+    ASSERT_EQ((reg.count<foo, bar>()), 25);
+    ASSERT_EQ(reg.count<foo>(), 100);
+
+    apx::registry<foo> empty;
+    ASSERT_FALSE(empty.min<foo>(value).has_value());
+    ASSERT_EQ(empty.reduce<foo>(7, value, std::plus<>{}), 7);
+
+    const auto by_remainder = reg.group_by<foo>(
+        [](const foo& f) { return f.value % 3; },
+        [](const foo&) { return 1; },
+        std::plus<>{});
+    ASSERT_EQ(by_remainder.size(), 3);
+    ASSERT_EQ(by_remainder.at(0), 34);
+    ASSERT_EQ(by_remainder.at(1), 33);
+    ASSERT_EQ(by_remainder.at(2), 33);
+}
+
+TEST(registry_reduction, parallel_reductions_match_serial)
+{
+    apx::registry<foo, bar> reg;
+    for (int i = 0; i != 100000; ++i) {
+        auto e = reg.create();
+        reg.emplace<foo>(e, i);
+        if (i % 3 == 0) reg.emplace<bar>(e);
+    }
+
+    const auto value = [](const foo& f) { return static_cast<long long>(f.value); };
+    const auto pair_value = [](const foo& f, const bar&) { return static_cast<long long>(f.value); };
+    for (std::size_t threads : {1, 2, 7}) {
+        for (bool deterministic : {false, true}) {
+            const apx::reduce_options options{threads, deterministic};
+            ASSERT_EQ(reg.sum<foo>(value, options), 4999950000LL);
+            ASSERT_EQ((reg.sum<foo, bar>(pair_value, options)), 1666683333LL);
+            ASSERT_EQ((reg.count<foo, bar>(options)), 33334);
+            ASSERT_EQ(reg.max<foo>(value, options), 99999);
+
+            const auto groups = reg.group_by<foo>([](const foo& f) { return f.value % 2; }, value, std::plus<>{}, options);
+            ASSERT_EQ(groups.at(0), 2499950000LL);
+        }
+    }
+}
+
+TEST(registry_reduction, reductions_keep_the_order_of_the_storage)
+{
+    apx::registry<foo> reg;
+    for (int i = 0; i != 10; ++i) {
+        reg.emplace<foo>(reg.create(), i);
+    }
+    const auto digit = [](const foo& f) { return std::to_string(f.value); };
+    ASSERT_EQ(reg.reduce<foo>(std::string{}, digit, std::plus<>{}), "0123456789");
+
+    // Composing affine maps is associative but not commutative, so any reordering of
+    // the fold changes the result.
+    using affine = std::pair<std::uint64_t, std::uint64_t>;
+    const auto step = [](const foo& f) { return affine{3, static_cast<std::uint64_t>(f.value)}; };
+    const auto then = [](const affine& a, const affine& b) { return affine{b.first * a.first, b.first * a.second + b.second}; };
+    for (int i = 10; i != 100003; ++i) {
+        reg.emplace<foo>(reg.create(), i);
+    }
+    affine expected{1, 0};
+    for (auto [f] : reg.view_get<foo>()) {
+        expected = then(expected, step(f));
+    }
+    for (std::size_t threads : {1, 2, 3, 8}) {
+        for (bool deterministic : {false, true}) {
+            ASSERT_EQ(reg.reduce<foo>(affine{1, 0}, step, then, {threads, deterministic}), expected);
+        }
+    }
+}
+
+TEST(registry_reduction, deterministic_reductions_do_not_depend_on_threads)
+{
+    apx::registry<foo> reg;
+    for (int i = 0; i != 100000; ++i) {
+        reg.emplace<foo>(reg.create(), i);
+    }
+
+    // Adding floats is not associative, so only a fixed order gives identical sums.
+    const auto value = [](const foo& f) { return 1.0f / static_cast<float>(f.value + 1); };
+    const float expected = reg.sum<foo>(value, {1, true});
+    for (std::size_t threads : {2, 3, 8}) {
+        ASSERT_EQ(reg.sum<foo>(value, {threads, true}), expected);
+    }
+}
+
+namespace {
+
+// Everything about a registry<foo, bar> that rollback should restore, including the
+// order of its storage.
+auto snapshot(const apx::registry<foo, bar>& reg)
+{
+    std::vector<apx::entity> entities{reg.all().begin(), reg.all().end()};
+    std::vector<std::pair<apx::entity, int>> foos;
+    for (auto e : reg.view<foo>()) {
+        foos.emplace_back(e, reg.get<foo>(e).value);
+    }
+    const auto bars = reg.view<bar>();
+    return std::make_tuple(entities, foos, std::vector<apx::entity>{bars.begin(), bars.end()});
+}
+
+}
+
+TEST(registry_journal, rollback_restores_earlier_ticks)
+{
+    apx::registry<foo, bar> reg;
+    reg.enable_journal(8);
+
+    std::vector<apx::entity> entities;
+    for (int i = 0; i != 10; ++i) {
+        entities.push_back(reg.create_with(foo{i}));
+        if (i % 2 == 0) reg.emplace<bar>(entities.back());
+    }
+
+    std::vector<decltype(snapshot(reg))> snapshots;
+    for (std::uint64_t tick = 0; tick != 5; ++tick) {
+        snapshots.push_back(snapshot(reg));
+        reg.begin_tick(tick);
+
+        reg.patch<foo>(entities[tick], [](foo& f) { f.value += 100; });
+        reg.remove<bar>(entities[tick]);
+        reg.destroy(entities[tick + 5]);
+        auto e = reg.create_with(foo{-static_cast<int>(tick)}, bar{});
+        reg.remove<foo>(e);
+        reg.add<foo>(e, {7});
+    }
+
+    const auto end = snapshot(reg);
+    ASSERT_TRUE(reg.rollback_to(5));
+    ASSERT_EQ(snapshot(reg), end);
+
+    for (std::uint64_t tick = 5; tick-- != 0;) {
+        ASSERT_TRUE(reg.rollback_to(tick));
+        ASSERT_EQ(snapshot(reg), snapshots[tick]);
+    }
+
+    // The destroyed entities are valid again, and new ones reuse the same indices.
+    ASSERT_TRUE(reg.valid(entities[9]));
+    reg.begin_tick(10);
+    reg.destroy(entities[9]);
+    ASSERT_EQ(apx::to_index(reg.create()), apx::to_index(entities[9]));
+}
+
+TEST(registry_journal, journal_keeps_only_recent_ticks)
+{
+    apx::registry<foo, bar> reg;
+    reg.enable_journal(3);
+    auto e = reg.create_with(foo{0});
+
+    for (std::uint64_t tick = 0; tick != 6; ++tick) {
+        reg.begin_tick(tick);
+        reg.patch<foo>(e, [](foo& f) { ++f.value; });
+    }
+
+    ASSERT_FALSE(reg.rollback_to(2));
+    ASSERT_EQ(reg.get<foo>(e).value, 6);
+    ASSERT_TRUE(reg.rollback_to(3));
+    ASSERT_EQ(reg.get<foo>(e).value, 3);
+}
+
+TEST(registry_journal, move_only_components_are_moved_into_the_journal)
+{
+    apx::registry<std::unique_ptr<int>, foo> reg;
+    reg.enable_journal(2);
+    auto e = reg.create_with(std::make_unique<int>(1), foo{});
+    const int* value = reg.get<std::unique_ptr<int>>(e).get();
+
+    reg.begin_tick(0);
+    reg.remove<std::unique_ptr<int>>(e);
+    reg.destroy(e);
+    ASSERT_FALSE(reg.valid(e));
+
+    // Rolling back restores the component that was removed, not a copy of it.
+    ASSERT_TRUE(reg.rollback_to(0));
+    ASSERT_EQ(reg.get<std::unique_ptr<int>>(e).get(), value);
+
+    // Writes to it cannot be recorded, so are kept.
+    reg.begin_tick(1);
+    reg.patch<std::unique_ptr<int>>(e, [](auto& p) { *p = 2; });
+    ASSERT_TRUE(reg.rollback_to(1));
+    ASSERT_EQ(*reg.get<std::unique_ptr<int>>(e), 2);
+}
+
+TEST(registry_determinism, iteration_order_depends_only_on_contents)
+{
+    // The same entities and components, reached by different histories.
+    apx::registry<foo, bar> a;
+    apx::registry<foo, bar> b;
+    a.enable_deterministic();
+    b.enable_deterministic();
+
+    std::vector<apx::entity> as;
+    std::vector<apx::entity> bs;
+    for (int i = 0; i != 8; ++i) {
+        as.push_back(a.create());
+        bs.push_back(b.create());
+    }
+    for (int i = 0; i != 8; ++i) {
+        a.add<foo>(as[i], {i});
+        b.add<foo>(bs[7 - i], {7 - i});
+    }
+    a.destroy({as[3], as[5]});
+    b.destroy({bs[5], bs[3]});
+    b.remove<foo>(bs[1]);
+    b.add<foo>(bs[1], {1});
+
+    const auto a_foos = a.view<foo>();
+    const auto b_foos = b.view<foo>();
+    ASSERT_TRUE(std::ranges::equal(a_foos, b_foos));
+    ASSERT_TRUE(std::ranges::is_sorted(a_foos));
+
+    // Both reuse the lowest destroyed index first.
+    ASSERT_EQ(a.create(), b.create());
+    ASSERT_EQ(apx::to_index(a.create()), 5);
+}
+
+TEST(registry_determinism, pool_order_depends_only_on_contents)
+{
+    apx::registry<foo> a;
+    apx::registry<foo> b;
+    a.enable_deterministic();
+    b.enable_deterministic();
+    b.enable_journal(1);
+
+    std::vector<apx::entity> as;
+    std::vector<apx::entity> bs;
+    for (int i = 0; i != 8; ++i) {
+        as.push_back(a.create());
+        bs.push_back(b.create());
+    }
+    for (const int i : {1, 2, 4, 6, 7}) {
+        a.destroy(as[i]);
+    }
+    for (const int i : {7, 6, 4, 2, 1}) {
+        b.destroy(bs[i]);
+    }
+    ASSERT_TRUE(std::ranges::equal(a.pool(), b.pool()));
+    ASSERT_TRUE(std::ranges::is_sorted(a.pool()));
+
+    // Including after a rollback puts back entities taken from and returned to it.
+    b.begin_tick(0);
+    static_cast<void>(b.create());
+    b.destroy(bs[3]);
+    b.destroy(bs[0]);
+    ASSERT_TRUE(b.rollback_to(0));
+    ASSERT_TRUE(std::ranges::equal(a.pool(), b.pool()));
+}
+
+TEST(registry_determinism, checksum_tracks_changes)
+{
+    apx::registry<foo, bar> a;
+    apx::registry<foo, bar> b;
+    a.enable_checksum();
+    b.enable_checksum();
+    ASSERT_EQ(a.checksum(), b.checksum());
+
+    auto ea = a.create_with(foo{1}, bar{});
+    auto eb = b.create_with(foo{1});
+    ASSERT_NE(a.checksum(), b.checksum());
+    b.emplace<bar>(eb);
+    ASSERT_EQ(a.checksum(), b.checksum());
+
+    a.patch<foo>(ea, [](foo& f) { f.value = 2; });
+    ASSERT_NE(a.checksum(), b.checksum());
+    b.patch<foo>(eb, [](foo& f) { f.value = 2; });
+    ASSERT_EQ(a.checksum(), b.checksum());
+
+    // It matches one computed from scratch, and follows rollbacks.
+    a.enable_journal(4);
+    a.enable_deterministic();
+    a.begin_tick(0);
+    const auto before = a.checksum();
+    for (int i = 0; i != 6; ++i) {
+        static_cast<void>(a.create_with(foo{i}));
+    }
+    a.destroy(ea);
+    a.add<bar>(a.create(), {});
+    const auto after = a.checksum();
+    a.enable_checksum();
+    ASSERT_EQ(a.checksum(), after);
+
+    ASSERT_TRUE(a.rollback_to(0));
+    ASSERT_EQ(a.checksum(), before);
+    ASSERT_EQ(a.checksum(), b.checksum());
+    ASSERT_TRUE(std::ranges::equal(a.view<foo>(), b.view<foo>()));
+}
+
+namespace {
+
+struct name { std::string value; };
+
+}
+
+template <>
+struct apx::component_hash<name>
+{
+    std::uint64_t operator()(const name& n) const noexcept
+    {
+        return std::hash<std::string>{}(n.value);
+    }
+};
+
+TEST(registry_determinism, components_without_a_hash)
+{
+    // A component without a hash only rules out the checksum.
+    apx::registry<std::string, foo> reg;
+    auto e = reg.create();
+    reg.add<std::string>(e, "a");
+    reg.patch<std::string>(e, [](std::string& s) { s += "b"; });
+    ASSERT_EQ(reg.get<std::string>(e), "ab");
+    reg.remove<std::string>(e);
+    reg.destroy(e);
+
+    // And one with a hash of its own can take part in it.
+    apx::registry<name, foo> a;
+    apx::registry<name, foo> b;
+    a.enable_checksum();
+    b.enable_checksum();
+    static_cast<void>(a.create_with(name{"x"}));
+    auto eb = b.create_with(name{"y"});
+    ASSERT_NE(a.checksum(), b.checksum());
+    b.patch<name>(eb, [](name& n) { n.value = "x"; });
+    ASSERT_EQ(a.checksum(), b.checksum());
+}
+
+TEST(registry, bulk_create_and_add)
+{
+    apx::registry<foo, bar> reg;
+    reg.destroy(reg.create());
+    reg.enable_journal(1);
+    reg.begin_tick(0);
+
+    std::vector<apx::entity> entities(10);
+    reg.create(entities);
+    ASSERT_EQ(reg.size(), 10);
+    ASSERT_TRUE(reg.valid(entities));
+    ASSERT_EQ(apx::to_index(entities[0]), 0);
+
+    std::vector<foo> foos;
+    for (int i = 0; i != 10; ++i) {
+        foos.push_back({i});
+    }
+    reg.add<foo>(std::span{entities}.subspan(2), std::span<const foo>{foos}.subspan(2));
+    for (int i = 0; i != 10; ++i) {
+        ASSERT_EQ(reg.has<foo>(entities[i]), i >= 2);
+        if (i >= 2) {
+            ASSERT_EQ(reg.get<foo>(entities[i]).value, i);
+        }
+    }
+
+    // Bulk changes are journalled like any other.
+    ASSERT_TRUE(reg.rollback_to(0));
+    ASSERT_EQ(reg.size(), 0);
+    ASSERT_EQ(reg.storage<foo>().size(), 0);
+
+    // The same entities as creating them one at a time.
+    std::vector<apx::entity> again(10);
+    reg.create(again);
+    ASSERT_EQ(again, entities);
+    apx::registry<foo, bar> single;
+    single.destroy(single.create());
+    for (const apx::entity entity : entities) {
+        ASSERT_EQ(single.create(), entity);
+    }
+}
+
 TEST(registry_copying, copying_entities_within_reg)
 {
     apx::registry<foo> reg;
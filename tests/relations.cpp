@@ -0,0 +1,115 @@
+#include <apecs/relations.hpp>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+namespace {
+
+struct health { int value = 0; };
+
+struct targets {};
+struct owned_by {};
+
+using registry_type = apx::registry<health>;
+using relations_type = apx::relations<registry_type, targets, owned_by>;
+
+std::vector<apx::entity> sorted(const std::span<const apx::entity> entities)
+{
+    std::vector<apx::entity> out{entities.begin(), entities.end()};
+    std::ranges::sort(out);
+    return out;
+}
+
+}
+
+TEST(relations, links_are_seen_from_both_ends)
+{
+    registry_type reg;
+    relations_type rel{reg};
+    const auto a = reg.create();
+    const auto b = reg.create();
+    const auto c = reg.create();
+
+    ASSERT_TRUE(rel.link<targets>(a, c));
+    ASSERT_TRUE(rel.link<targets>(b, c));
+    ASSERT_TRUE(rel.link<targets>(a, b));
+    ASSERT_FALSE(rel.link<targets>(a, c));
+    ASSERT_TRUE(rel.link<owned_by>(a, a));
+    ASSERT_EQ(rel.size<targets>(), 3);
+
+    ASSERT_EQ(sorted(rel.sources<targets>(c)), (std::vector{a, b}));
+    ASSERT_EQ(sorted(rel.targets<targets>(a)), (std::vector{b, c}));
+    ASSERT_TRUE(rel.linked<targets>(b, c));
+    ASSERT_FALSE(rel.linked<targets>(c, b));
+    ASSERT_FALSE(rel.linked<owned_by>(a, c));
+    ASSERT_EQ(rel.sources<owned_by>(a).size(), 1);
+
+    ASSERT_TRUE(rel.unlink<targets>(a, c));
+    ASSERT_FALSE(rel.unlink<targets>(a, c));
+    ASSERT_EQ(sorted(rel.sources<targets>(c)), (std::vector{b}));
+    ASSERT_EQ(sorted(rel.targets<targets>(a)), (std::vector{b}));
+    ASSERT_EQ(rel.size<targets>(), 2);
+}
+
+TEST(relations, destroying_an_entity_removes_its_links)
+{
+    registry_type reg;
+    relations_type rel{reg};
+    std::vector<apx::entity> units;
+    const auto player = reg.create();
+    for (int i = 0; i != 100; ++i) {
+        units.push_back(reg.create());
+        rel.link<owned_by>(units.back(), player);
+        rel.link<targets>(units.back(), units.front());
+        if (i != 0) {
+            rel.link<targets>(units.front(), units.back());
+        }
+    }
+    ASSERT_EQ(rel.sources<owned_by>(player).size(), 100);
+
+    // Destroying every other unit leaves the links between the others in place.
+    for (std::size_t i = 1; i < units.size(); i += 2) {
+        reg.destroy(units[i]);
+    }
+    ASSERT_EQ(rel.sources<owned_by>(player).size(), 50);
+    ASSERT_EQ(rel.targets<targets>(units.front()).size(), 50);
+    for (std::size_t i = 2; i < units.size(); i += 2) {
+        ASSERT_TRUE(rel.linked<owned_by>(units[i], player));
+        ASSERT_TRUE(rel.linked<targets>(units[i], units.front()));
+        ASSERT_TRUE(rel.linked<targets>(units.front(), units[i]));
+    }
+
+    // A recycled entity does not inherit the links of the one it replaces.
+    reg.destroy(player);
+    ASSERT_EQ(rel.size<owned_by>(), 0);
+    const auto recycled = reg.create();
+    ASSERT_EQ(apx::to_index(recycled), apx::to_index(units[1]));
+    ASSERT_TRUE(rel.sources<targets>(recycled).empty());
+
+    reg.clear();
+    ASSERT_EQ(rel.size<targets>(), 0);
+}
+
+TEST(relations, copies_of_the_registry_leave_links_alone)
+{
+    registry_type reg;
+    relations_type rel{reg};
+    const auto a = reg.create();
+    const auto b = reg.create();
+    rel.link<targets>(a, b);
+
+    // Destroying entities in a copy, or the copy itself, is not seen by the relations.
+    {
+        auto copy = reg;
+        copy.destroy(a);
+        ASSERT_TRUE(reg.valid(a));
+        ASSERT_EQ(rel.size<targets>(), 1);
+    }
+    ASSERT_EQ(rel.size<targets>(), 1);
+    ASSERT_TRUE(rel.linked<targets>(a, b));
+
+    registry_type other;
+    other = reg;
+    other.clear();
+    ASSERT_TRUE(rel.linked<targets>(a, b));
+}
@@ -0,0 +1,178 @@
+#include <apecs/replication.hpp>
+#include <gtest/gtest.h>
+
+namespace {
+
+struct position { int x = 0; int y = 0; };
+struct health { int value = 100; };
+struct secret { int value = 0; };
+
+using registry_type = apx::registry<position, health, secret>;
+using replicator_type = apx::replicator<registry_type, position, health>;
+using replica_type = apx::replica<registry_type, position, health>;
+
+// Checks that the replica holds exactly the entities of the server that pass the
+// filter, with the same replicated components.
+template <typename Filter>
+void expect_replicated(const registry_type& server, const registry_type& client, const replica_type& replica, Filter filter)
+{
+    std::size_t expected = 0;
+    for (const apx::entity e : server.all()) {
+        const apx::entity local = replica.local(e);
+        if (!filter(server, e)) {
+            EXPECT_EQ(local, apx::null);
+            continue;
+        }
+        ++expected;
+        ASSERT_TRUE(client.valid(local));
+        ASSERT_EQ(server.has<position>(e), client.has<position>(local));
+        ASSERT_EQ(server.has<health>(e), client.has<health>(local));
+        ASSERT_FALSE(client.has<secret>(local));
+        if (server.has<position>(e)) {
+            ASSERT_EQ(server.get<position>(e).x, client.get<position>(local).x);
+            ASSERT_EQ(server.get<position>(e).y, client.get<position>(local).y);
+        }
+        if (server.has<health>(e)) {
+            ASSERT_EQ(server.get<health>(e).value, client.get<health>(local).value);
+        }
+    }
+    ASSERT_EQ(replica.size(), expected);
+    ASSERT_EQ(client.size(), expected);
+}
+
+bool everything(const registry_type&, apx::entity)
+{
+    return true;
+}
+
+bool on_the_left(const registry_type& reg, const apx::entity e)
+{
+    return reg.has<position>(e) && reg.get<position>(e).x < 0;
+}
+
+// Makes some changes of every kind to the registry for the given frame.
+void simulate(registry_type& reg, std::vector<apx::entity>& entities, const int frame)
+{
+    for (int i = 0; i != 3; ++i) {
+        entities.push_back(reg.create_with(position{frame - i * 4, i}, secret{frame}));
+    }
+    if (frame % 3 == 0 && reg.valid(entities[frame]) && !reg.has<health>(entities[frame])) {
+        reg.add<health>(entities[frame], {frame});
+    }
+    if (frame % 4 == 1 && reg.valid(entities[frame / 2])) {
+        reg.destroy(entities[frame / 2]);
+    }
+    for (const apx::entity e : entities) {
+        if (reg.valid(e) && reg.has<position>(e) && (apx::to_index(e) + frame) % 5 == 0) {
+            reg.patch<position>(e, [](position& p) { p.x = -p.x - 1; });
+        }
+    }
+    if (frame % 5 == 2 && reg.valid(entities[frame]) && reg.has<health>(entities[frame])) {
+        reg.remove<health>(entities[frame]);
+    }
+}
+
+}
+
+TEST(replication, consumers_see_their_share_of_the_world)
+{
+    registry_type server;
+    for (int i = 0; i != 5; ++i) {
+        static_cast<void>(server.create_with(position{i, i}, health{i}));
+    }
+
+    replicator_type replicator{server};
+    const auto all = replicator.add_consumer();
+    const auto left = replicator.add_consumer(on_the_left);
+
+    registry_type all_client;
+    registry_type left_client;
+    replica_type all_replica{all_client};
+    replica_type left_replica{left_client};
+
+    std::vector<apx::entity> entities{server.all().begin(), server.all().end()};
+    std::vector<std::byte> packet;
+    for (int frame = 0; frame != 20; ++frame) {
+        simulate(server, entities, frame);
+        replicator.end_frame();
+
+        replicator.encode(all, packet);
+        replicator.acknowledge(all, *all_replica.apply(packet));
+        expect_replicated(server, all_client, all_replica, everything);
+
+        replicator.encode(left, packet);
+        replicator.acknowledge(left, *left_replica.apply(packet));
+        expect_replicated(server, left_client, left_replica, on_the_left);
+    }
+
+    // Once up to date, a packet is only a header.
+    replicator.end_frame();
+    replicator.encode(all, packet);
+    ASSERT_EQ(packet.size(), 1);
+    ASSERT_EQ(replicator.stats(all).packets, 21);
+    ASSERT_GT(replicator.stats(all).bytes, replicator.stats(left).bytes);
+}
+
+TEST(replication, lost_packets_are_covered_by_later_ones)
+{
+    registry_type server;
+    replicator_type replicator{server, 4};
+    const auto left = replicator.add_consumer(on_the_left);
+
+    registry_type client;
+    replica_type replica{client};
+
+    std::vector<apx::entity> entities;
+    std::vector<std::byte> packet;
+    for (int frame = 0; frame != 30; ++frame) {
+        simulate(server, entities, frame);
+        replicator.end_frame();
+        replicator.encode(left, packet);
+
+        // Lose two packets in every three, and for a while all of them, so that the
+        // replicator runs out of history.
+        if (frame % 3 == 2 && (frame < 10 || frame > 20)) {
+            replicator.acknowledge(left, *replica.apply(packet));
+            expect_replicated(server, client, replica, on_the_left);
+        }
+    }
+}
+
+TEST(replication, rescan_picks_up_changes_of_interest)
+{
+    registry_type server;
+    for (int i = 0; i != 10; ++i) {
+        static_cast<void>(server.create_with(position{i, 0}));
+    }
+
+    int threshold = 3;
+    replicator_type replicator{server};
+    const auto id = replicator.add_consumer([&](const registry_type& reg, apx::entity e) {
+        return reg.get<position>(e).x < threshold;
+    });
+
+    registry_type client;
+    replica_type replica{client};
+    std::vector<std::byte> packet;
+    const auto update = [&] {
+        replicator.end_frame();
+        replicator.encode(id, packet);
+        replicator.acknowledge(id, *replica.apply(packet));
+    };
+
+    update();
+    ASSERT_EQ(client.size(), 3);
+
+    threshold = 6;
+    update();
+    ASSERT_EQ(client.size(), 3);
+
+    replicator.rescan(id);
+    update();
+    ASSERT_EQ(client.size(), 6);
+
+    threshold = 1;
+    replicator.rescan(id);
+    update();
+    ASSERT_EQ(client.size(), 1);
+}
@@ -0,0 +1,82 @@
+#include <apecs/schedule.hpp>
+#include <gtest/gtest.h>
+
+namespace {
+
+struct transform { float x = 0.0f; };
+struct velocity { float x = 0.0f; };
+struct mass { float value = 1.0f; };
+
+using registry_type = apx::registry<transform, velocity, mass>;
+
+}
+
+TEST(schedule, stages_over_the_same_components_are_fused)
+{
+    registry_type reg;
+    for (int i = 0; i != 10; ++i) {
+        static_cast<void>(reg.create_with(transform{}, velocity{static_cast<float>(i)}));
+    }
+
+    std::vector<std::string> calls;
+    apx::schedule<registry_type> schedule;
+    schedule.add<transform, velocity>([&](transform& t, velocity& v) { t.x += v.x; calls.push_back("move"); });
+    schedule.add<transform, velocity>([&](transform& t, velocity& v) { v.x = t.x; calls.push_back("copy"); });
+    ASSERT_EQ(schedule.passes(), 1);
+
+    schedule.run(reg);
+    ASSERT_EQ(calls.size(), 20);
+    ASSERT_EQ(calls[0], "move");
+    ASSERT_EQ(calls[1], "copy");
+    for (auto [t, v] : reg.view_get<transform, velocity>()) {
+        ASSERT_EQ(t.x, v.x);
+    }
+}
+
+TEST(schedule, stages_with_more_components_skip_entities_without_them)
+{
+    registry_type reg;
+    for (int i = 0; i != 10; ++i) {
+        auto e = reg.create_with(transform{}, velocity{1.0f});
+        if (i % 2 == 0) reg.emplace<mass>(e, 2.0f);
+    }
+
+    int heavy = 0;
+    apx::schedule<registry_type> schedule;
+    schedule.add<transform, velocity>([](transform& t, velocity& v) { t.x += v.x; });
+    schedule.add<transform, velocity, mass>([&](transform& t, velocity&, mass& m) { t.x *= m.value; ++heavy; });
+
+    // The other way round, the first pass would not visit entities without mass.
+    schedule.add<velocity>([](velocity& v) { v.x = 0.0f; });
+    ASSERT_EQ(schedule.passes(), 2);
+
+    schedule.run(reg);
+    ASSERT_EQ(heavy, 5);
+    for (auto e : reg.view<transform>()) {
+        ASSERT_EQ(reg.get<transform>(e).x, reg.has<mass>(e) ? 2.0f : 1.0f);
+        ASSERT_EQ(reg.get<velocity>(e).x, 0.0f);
+    }
+}
+
+TEST(schedule, conflicting_access_splits_passes)
+{
+    registry_type reg;
+    std::vector<apx::entity> entities;
+    for (int i = 0; i != 10; ++i) {
+        entities.push_back(reg.create_with(transform{static_cast<float>(i)}, velocity{}));
+    }
+
+    // The second stage reads the transform of another entity, which the first writes,
+    // so it must see every transform updated before it runs.
+    apx::schedule<registry_type> schedule;
+    schedule.add<transform>([](transform& t) { t.x += 100.0f; });
+    schedule.add<transform, velocity>(
+        [&](transform&, velocity& v) { v.x = reg.get<transform>(entities.back()).x; },
+        apx::reads<transform>{});
+    ASSERT_EQ(schedule.passes(), 2);
+
+    schedule.run(reg);
+    for (auto [v] : reg.view_get<velocity>()) {
+        ASSERT_EQ(v.x, 109.0f);
+    }
+}
@@ -0,0 +1,119 @@
+#include <apecs/shared.hpp>
+#include <gtest/gtest.h>
+
+#include <thread>
+
+namespace {
+
+struct position { int x = 0; int y = 0; };
+struct tag {};
+
+using registry_type = apx::registry<position, tag>;
+
+std::string region_name(const char* test)
+{
+    return "/apecs_" + std::string{test} + "_" + std::to_string(::getpid());
+}
+
+}
+
+TEST(shared, readers_see_the_published_registry)
+{
+    registry_type reg;
+    for (int i = 0; i != 50; ++i) {
+        auto e = reg.create_with(position{i, 2 * i});
+        if (i % 2 == 0) {
+            reg.add<tag>(e, {});
+        }
+    }
+    reg.destroy(reg.from_index(3));
+
+    const auto name = region_name("published");
+    apx::shared_publisher<registry_type> publisher{name, 1 << 20};
+    ASSERT_TRUE(publisher);
+
+    apx::shared_reader<position, tag> reader{name};
+    ASSERT_TRUE(reader);
+    ASSERT_FALSE(reader.read([](const auto&) {}));
+
+    ASSERT_TRUE(publisher.publish(reg));
+    ASSERT_EQ(reader.epoch(), 2);
+
+    std::vector<apx::entity> entities;
+    std::vector<int> xs;
+    std::size_t tagged = 0;
+    ASSERT_TRUE(reader.read([&](const auto& snapshot) {
+        entities.assign(snapshot.entities().begin(), snapshot.entities().end());
+        xs.clear();
+        for (const position& p : snapshot.template values<position>()) {
+            xs.push_back(p.x);
+        }
+        tagged = snapshot.template keys<tag>().size();
+    }));
+
+    ASSERT_TRUE(std::ranges::equal(entities, reg.all()));
+    ASSERT_EQ(xs.size(), 49);
+    ASSERT_EQ(tagged, 25);
+    const auto& positions = reg.storage<position>().values();
+    for (std::size_t i = 0; i != xs.size(); ++i) {
+        ASSERT_EQ(xs[i], positions[i].x);
+    }
+
+    // A region of other components is refused.
+    apx::shared_reader<position> other{name};
+    ASSERT_FALSE(other);
+}
+
+TEST(shared, publish_fails_when_the_region_is_full)
+{
+    registry_type reg;
+    for (int i = 0; i != 1000; ++i) {
+        static_cast<void>(reg.create_with(position{i, i}));
+    }
+    apx::shared_publisher<registry_type> publisher{region_name("full"), 4096};
+    ASSERT_TRUE(publisher);
+    ASSERT_FALSE(publisher.publish(reg));
+    ASSERT_EQ(publisher.epoch(), 0);
+}
+
+TEST(shared, reads_are_consistent_while_publishing)
+{
+    registry_type reg;
+    std::vector<apx::entity> entities;
+    for (int i = 0; i != 1000; ++i) {
+        entities.push_back(reg.create_with(position{0, 0}));
+    }
+
+    const auto name = region_name("consistent");
+    apx::shared_publisher<registry_type> publisher{name, 1 << 20};
+    apx::shared_reader<position, tag> reader{name};
+    publisher.publish(reg);
+
+    // Every publish sets all the positions to the same value, so a consistent read sees
+    // them all equal.
+    std::atomic<bool> done{false};
+    std::thread writer{[&] {
+        for (int round = 1; round != 2000; ++round) {
+            for (const apx::entity e : entities) {
+                reg.get<position>(e).x = round;
+            }
+            publisher.publish(reg);
+        }
+        done = true;
+    }};
+
+    std::size_t reads = 0;
+    while (!done) {
+        std::vector<position> copy;
+        if (reader.read([&](const auto& snapshot) {
+            const auto values = snapshot.template values<position>();
+            copy.assign(values.begin(), values.end());
+        })) {
+            ++reads;
+            ASSERT_EQ(copy.size(), 1000);
+            ASSERT_TRUE(std::ranges::all_of(copy, [&](const position& p) { return p.x == copy.front().x; }));
+        }
+    }
+    writer.join();
+    ASSERT_GT(reads, 0);
+}
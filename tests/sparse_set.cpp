@@ -43,4 +43,99 @@ TEST(sparse_set, each_can_modify_elements)
     }
 
     ASSERT_EQ(set[1], 6);
-}
\ No newline at end of file
+}
+
+TEST(sparse_set, erase_from_middle_unsorts)
+{
+    apx::sparse_set<int> set;
+    set.insert(1, 10);
+    set.insert(2, 20);
+    set.insert(3, 30);
+    ASSERT_TRUE(set.is_sorted());
+
+    set.erase(3);
+    ASSERT_TRUE(set.is_sorted());
+
+    set.erase(1);
+    ASSERT_FALSE(set.is_sorted());
+}
+
+TEST(sparse_set, sort_orders_by_index)
+{
+    apx::sparse_set<int> set;
+    set.insert(5, 50);
+    set.insert(1, 10);
+    set.insert(3, 30);
+    ASSERT_FALSE(set.is_sorted());
+
+    set.sort();
+    ASSERT_TRUE(set.is_sorted());
+    ASSERT_TRUE(std::ranges::is_sorted(set.keys()));
+    ASSERT_EQ(set[1], 10);
+    ASSERT_EQ(set[3], 30);
+    ASSERT_EQ(set[5], 50);
+}
+
+TEST(sparse_set, bitmap_tracks_membership)
+{
+    apx::sparse_set<int> set;
+    set.insert(3, 30);
+    set.enable_bitmap();
+    set.insert(5000, 50);
+
+    const auto* bitmap = set.bitmap();
+    ASSERT_NE(bitmap, nullptr);
+    ASSERT_TRUE(bitmap->test(3));
+    ASSERT_TRUE(bitmap->test(5000));
+    ASSERT_FALSE(bitmap->test(4));
+    ASSERT_EQ(bitmap->size(), 2);
+
+    set.erase(5000);
+    ASSERT_FALSE(bitmap->test(5000));
+    ASSERT_EQ(bitmap->find(5000 / apx::bitmap_index::block_bits), nullptr);
+
+    set.disable_bitmap();
+    ASSERT_EQ(set.bitmap(), nullptr);
+}
+
+TEST(sparse_set, entity_keys_are_stored_by_index)
+{
+    apx::sparse_set<int, apx::entity> set;
+    const auto e = apx::combine(4, 7);
+
+    set.insert(e, 5);
+    ASSERT_TRUE(set.has(4));
+    ASSERT_EQ(set[4], 5);
+    ASSERT_EQ(set.key(4), e);
+    ASSERT_EQ(set.keys()[0], e);
+}
+
+TEST(sparse_set, find_returns_pointer_or_null)
+{
+    apx::sparse_set<int> set;
+    set.insert(3, 30);
+
+    ASSERT_EQ(set.find(3), &set[3]);
+    ASSERT_EQ(set.find(4), nullptr);
+    ASSERT_EQ(set.find(1000), nullptr);
+}
+
+TEST(sparse_set, keep_sorted_preserves_key_order)
+{
+    apx::sparse_set<int> set;
+    for (int i : {5, 1, 9, 3}) {
+        set.insert(i, i * 10);
+    }
+    set.erase(1);
+    ASSERT_FALSE(set.is_sorted());
+
+    set.keep_sorted();
+    set.insert(4, 40);
+    set.insert(0, 0);
+    set.erase(5);
+    ASSERT_TRUE(set.is_sorted());
+    ASSERT_TRUE(std::ranges::equal(set.keys(), std::vector<std::size_t>{0, 3, 4, 9}));
+    ASSERT_TRUE(std::ranges::equal(set.values(), std::vector<int>{0, 30, 40, 90}));
+    ASSERT_EQ(set[4], 40);
+    ASSERT_EQ(set[9], 90);
+}
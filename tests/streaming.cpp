@@ -0,0 +1,124 @@
+#include <apecs/streaming.hpp>
+#include <gtest/gtest.h>
+
+namespace {
+
+struct position { int x = 0; int y = 0; };
+struct health { int value = 0; };
+struct tag {};
+
+using registry_type = apx::registry<position, health, tag>;
+using loader_type = apx::streaming_loader<registry_type>;
+
+// A chunk of the given number of entities, each with a mix of components.
+std::vector<std::byte> make_chunk(registry_type& source, std::vector<apx::entity>& entities, const int count)
+{
+    entities.clear();
+    for (int i = 0; i != count; ++i) {
+        entities.push_back(source.create_with(position{i, -i}));
+        if (i % 3 == 0) {
+            source.add<health>(entities.back(), {i * 10});
+        }
+        if (i % 4 == 0) {
+            source.add<tag>(entities.back(), {});
+        }
+    }
+    std::vector<std::byte> chunk;
+    apx::save_chunk(source, entities, chunk);
+    return chunk;
+}
+
+void expect_same(const registry_type& a, const apx::entity x, const registry_type& b, const apx::entity y)
+{
+    ASSERT_EQ(a.get<position>(x).x, b.get<position>(y).x);
+    ASSERT_EQ(a.get<position>(x).y, b.get<position>(y).y);
+    ASSERT_EQ(a.has<health>(x), b.has<health>(y));
+    if (a.has<health>(x)) {
+        ASSERT_EQ(a.get<health>(x).value, b.get<health>(y).value);
+    }
+    ASSERT_EQ(a.has<tag>(x), b.has<tag>(y));
+}
+
+}
+
+TEST(streaming, chunks_are_loaded_in_order)
+{
+    registry_type source;
+    std::vector<apx::entity> first;
+    std::vector<apx::entity> second;
+    auto a = make_chunk(source, first, 50);
+    auto b = make_chunk(source, second, 20);
+
+    // The registry already has entities of its own, and some to reuse.
+    registry_type reg;
+    for (int i = 0; i != 10; ++i) {
+        static_cast<void>(reg.create_with(health{-1}));
+    }
+    reg.destroy(reg.from_index(3));
+
+    std::vector<std::vector<apx::entity>> loaded;
+    loader_type loader;
+    loader.load(std::move(a), [&](std::span<const apx::entity> e) { loaded.emplace_back(e.begin(), e.end()); });
+    loader.load(std::move(b), [&](std::span<const apx::entity> e) { loaded.emplace_back(e.begin(), e.end()); });
+    loader.flush();
+
+    ASSERT_EQ(loader.integrate(reg, 1000), 70);
+    ASSERT_EQ(loader.pending(), 0);
+    ASSERT_EQ(reg.size(), 79);
+    ASSERT_EQ(loaded.size(), 2);
+    ASSERT_EQ(loaded[0].size(), 50);
+    ASSERT_EQ(loaded[1].size(), 20);
+    ASSERT_EQ(apx::to_index(loaded[0][0]), 3);
+    for (std::size_t i = 0; i != first.size(); ++i) {
+        expect_same(source, first[i], reg, loaded[0][i]);
+    }
+    for (std::size_t i = 0; i != second.size(); ++i) {
+        expect_same(source, second[i], reg, loaded[1][i]);
+    }
+}
+
+TEST(streaming, integration_keeps_to_the_budget)
+{
+    registry_type source;
+    std::vector<apx::entity> entities;
+    loader_type loader;
+    bool done = false;
+    loader.load(make_chunk(source, entities, 100), [&](std::span<const apx::entity>) { done = true; });
+
+    registry_type reg;
+    ASSERT_EQ(loader.integrate(reg, 0), 0);
+    loader.flush();
+
+    for (const std::size_t expected : {30, 30, 30, 10}) {
+        ASSERT_FALSE(done);
+        ASSERT_EQ(loader.integrate(reg, 30), expected);
+
+        // Entities arrive with all of their components.
+        for (std::size_t i = 0; i != reg.size(); ++i) {
+            expect_same(source, entities[i], reg, reg.from_index(i));
+        }
+    }
+    ASSERT_TRUE(done);
+    ASSERT_EQ(loader.integrate(reg, 30), 0);
+    ASSERT_EQ(reg.size(), 100);
+}
+
+TEST(streaming, malformed_chunks_are_discarded)
+{
+    registry_type source;
+    std::vector<apx::entity> entities;
+    auto truncated = make_chunk(source, entities, 10);
+    truncated.pop_back();
+    auto other = make_chunk(source, entities, 10);
+    other[4] = std::byte{0x7f};
+
+    loader_type loader;
+    loader.load(std::move(truncated));
+    loader.load(std::move(other));
+    loader.load(make_chunk(source, entities, 10));
+    loader.flush();
+
+    registry_type reg;
+    ASSERT_EQ(loader.integrate(reg, 100), 10);
+    ASSERT_EQ(loader.failed(), 2);
+}
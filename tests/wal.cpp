@@ -0,0 +1,154 @@
+#include <apecs/wal.hpp>
+#include <gtest/gtest.h>
+
+#include <filesystem>
+
+namespace {
+
+struct position { int x = 0; int y = 0; };
+struct tag {};
+
+using registry_type = apx::registry<position, tag>;
+using log_type = apx::write_ahead_log<registry_type>;
+
+// A checkpoint and log in a directory of their own, removed afterwards.
+struct paths
+{
+    std::filesystem::path dir;
+    std::string           checkpoint;
+    std::string           log;
+
+    explicit paths(const char* name)
+        : dir{std::filesystem::path{::testing::TempDir()} / name}
+    {
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        checkpoint = (dir / "world.ckpt").string();
+        log = (dir / "world.wal").string();
+    }
+
+    ~paths()
+    {
+        std::filesystem::remove_all(dir);
+    }
+};
+
+auto snapshot(const registry_type& reg)
+{
+    std::vector<apx::entity> entities{reg.all().begin(), reg.all().end()};
+    std::vector<apx::entity> pool{reg.pool().begin(), reg.pool().end()};
+    std::vector<std::tuple<apx::entity, int, int>> positions;
+    for (const auto [entity, p] : reg.storage<position>().each()) {
+        positions.emplace_back(entity, p.x, p.y);
+    }
+    const auto tags = reg.storage<tag>().keys();
+    return std::make_tuple(entities, pool, positions, std::vector<apx::entity>{tags.begin(), tags.end()});
+}
+
+// Changes every kind of thing that the log records.
+void churn(registry_type& reg, const int seed)
+{
+    std::vector<apx::entity> entities;
+    for (int i = 0; i != 20; ++i) {
+        entities.push_back(reg.create_with(position{seed, i}));
+        if (i % 4 == 0) {
+            reg.add<tag>(entities.back(), {});
+        }
+    }
+    for (int i = 0; i < 20; i += 3) {
+        reg.destroy(entities[i]);
+    }
+    reg.remove<position>(entities[10]);
+    reg.patch<position>(entities[11], [](position& p) { p.x = -1; });
+}
+
+}
+
+TEST(wal, recovery_replays_committed_changes)
+{
+    const paths files{"apecs_wal_replay"};
+    registry_type reg;
+    churn(reg, 1);
+
+    auto expected = snapshot(reg);
+    {
+        log_type log{reg, files.checkpoint, files.log};
+        ASSERT_TRUE(log.ok());
+        churn(reg, 2);
+        log.commit();
+        churn(reg, 3);
+        ASSERT_TRUE(log.wait(log.commit()));
+        ASSERT_LE(log.syncs(), 2u);
+        expected = snapshot(reg);
+    }
+
+    registry_type recovered;
+    ASSERT_TRUE(apx::recover(files.checkpoint, files.log, recovered));
+    ASSERT_EQ(snapshot(recovered), expected);
+
+    // Carrying on from the recovered registry keeps the same entities.
+    ASSERT_EQ(recovered.create(), reg.create());
+}
+
+TEST(wal, checkpoint_starts_a_new_log)
+{
+    const paths files{"apecs_wal_checkpoint"};
+    registry_type reg;
+    log_type log{reg, files.checkpoint, files.log};
+
+    churn(reg, 1);
+    ASSERT_TRUE(log.checkpoint());
+    churn(reg, 2);
+    ASSERT_TRUE(log.sync());
+    ASSERT_TRUE(log.wait_checkpoint());
+
+    registry_type recovered;
+    ASSERT_TRUE(apx::recover(files.checkpoint, files.log, recovered));
+    ASSERT_EQ(snapshot(recovered), snapshot(reg));
+
+    // A crash while the next checkpoint was being written leaves the checkpoint before
+    // it, and the log that follows on from that as the old log.
+    const std::filesystem::path saved = files.dir / "saved.ckpt";
+    std::filesystem::copy_file(files.checkpoint, saved);
+    std::filesystem::copy_file(files.log, files.dir / "saved.wal");
+    ASSERT_TRUE(log.checkpoint());
+    churn(reg, 3);
+    ASSERT_TRUE(log.sync());
+    ASSERT_TRUE(log.wait_checkpoint());
+    ASSERT_FALSE(std::filesystem::exists(files.log + ".old"));
+
+    std::filesystem::copy_file(files.dir / "saved.wal", files.log + ".old", std::filesystem::copy_options::overwrite_existing);
+    ASSERT_TRUE(apx::recover(files.checkpoint, files.log, recovered));
+    ASSERT_EQ(snapshot(recovered), snapshot(reg));
+
+    std::filesystem::copy_file(saved, files.checkpoint, std::filesystem::copy_options::overwrite_existing);
+    ASSERT_TRUE(apx::recover(files.checkpoint, files.log, recovered));
+    ASSERT_EQ(snapshot(recovered), snapshot(reg));
+
+    // Without the old log, the new one does not follow on from the checkpoint.
+    std::filesystem::remove(files.log + ".old");
+    ASSERT_FALSE(apx::recover(files.checkpoint, files.log, recovered));
+}
+
+TEST(wal, torn_and_uncommitted_groups_are_lost)
+{
+    const paths files{"apecs_wal_torn"};
+    registry_type reg;
+    log_type log{reg, files.checkpoint, files.log};
+
+    churn(reg, 1);
+    ASSERT_TRUE(log.sync());
+    const auto expected = snapshot(reg);
+    const auto size = std::filesystem::file_size(files.log);
+
+    churn(reg, 2);
+    ASSERT_TRUE(log.sync());
+    churn(reg, 3);
+
+    // Cut the last group short, as a crash part way through writing it would.
+    std::filesystem::resize_file(files.log, size + (std::filesystem::file_size(files.log) - size) / 2);
+
+    registry_type recovered;
+    ASSERT_TRUE(apx::recover(files.checkpoint, files.log, recovered));
+    ASSERT_EQ(snapshot(recovered), expected);
+}